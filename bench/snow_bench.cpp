@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "../lib/conjugate_residual_solver.h"
+#include "../lib/CounterRandom.h"
+#include "../lib/LavaSolver.h"
+#include "../lib/Profiler.h"
+#include "../lib/SnowSolver.h"
+#include "../lib/svd.h"
+
+
+/**
+ * Micro-benchmarks of the solver kernels on seeded random scenes
+ *
+ * Particles are spread uniformly in a cube at the center of a unit domain of grid^3 nodes, and every benchmark runs
+ * for each combination of the particle counts and grid sizes. The best of the repeats is reported, as CSV or JSON.
+ * P2G and G2P are not separate functions, they are timed as the rasterize and g2p phases of solver updates.
+ */
+
+struct BenchOptions {
+    std::vector<size_t> particles = {10000};
+    std::vector<unsigned int> grids = {32};
+    uint64_t seed = 1;
+    unsigned int repeat = 5;
+    int iterations = 30; // Of the conjugate residual benchmark
+    std::string format = "csv";
+    std::string filter; // Substring of the names of the benchmark groups to run
+};
+
+struct BenchCase {
+    size_t numParticles;
+    unsigned int gridSize;
+    uint64_t seed;
+    unsigned int repeat;
+    int iterations;
+};
+
+struct BenchResult {
+    std::string benchmark;
+    size_t numParticles;
+    unsigned int gridSize;
+    size_t items; // Per run, what ns_per_item is relative to
+    double seconds; // Best run
+};
+
+typedef std::function<void(std::string const &name, size_t items, double seconds)> BenchReport;
+
+
+static volatile double sink; // Keeps the results of the kernels alive
+
+template<typename F>
+static double bestOf(unsigned int repeat, F const &run) {
+    auto best = std::numeric_limits<double>::infinity();
+    for (auto r = 0u; r < repeat; r++) {
+        auto start = Profiler::clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(Profiler::clock::now() - start).count());
+    }
+    return best;
+}
+
+
+// Scenes
+
+static double boundary = 0; // Width of the colliding shell of the domain
+
+static bool isBoundaryColliding(Node &node) {
+    auto const &p = node.position;
+    return p.x < boundary || p.y < boundary || p.z < boundary ||
+           p.x > 1 - boundary || p.y > 1 - boundary || p.z > 1 - boundary;
+}
+
+static void handleBoundaryCollision(Node &node) {
+    if (isBoundaryColliding(node)) node.velocity_star = glm::dvec3(0);
+}
+
+template<typename P>
+static void fillParticles(std::vector<P> &particleNodes, BenchCase const &c) {
+    CounterRandom random(c.seed);
+
+    auto mass = 400 * 0.4 * 0.4 * 0.4 / c.numParticles; // Density of packed snow
+
+    particleNodes.clear();
+    particleNodes.reserve(c.numParticles);
+    for (auto p = 0; p < c.numParticles; p++) {
+        // Drawn one by one, the evaluation order of constructor arguments is unspecified
+        glm::dvec3 position, velocity;
+        for (auto d = 0; d < 3; d++) position[d] = random.uniform(0.3, 0.7);
+        for (auto d = 0; d < 3; d++) velocity[d] = random.uniform(-0.1, 0.1);
+
+        particleNodes.emplace_back(position, mass);
+        particleNodes.back().velocity = velocity;
+    }
+}
+
+static SnowSolver *makeSnowSolver(BenchCase const &c) {
+    auto solver = new SnowSolver(1.0 / c.gridSize, glm::uvec3(c.gridSize));
+    boundary = 2 * solver->h;
+    solver->delta_t = 1e-4;
+    solver->handleNodeCollisionVelocityUpdate = handleBoundaryCollision;
+    fillParticles(solver->particleNodes, c);
+    return solver;
+}
+
+static LavaSolver *makeLavaSolver(BenchCase const &c) {
+    auto solver = new LavaSolver(1.0 / c.gridSize, glm::uvec3(c.gridSize));
+    boundary = 2 * solver->h;
+    solver->delta_t = 1e-4;
+    solver->isNodeColliding = isBoundaryColliding;
+    solver->handleNodeCollisionVelocityUpdate = handleBoundaryCollision;
+    fillParticles(solver->particleNodes, c);
+    for (auto &particleNode : solver->particleNodes) particleNode.temperature = 1200; // Molten, with heat to diffuse
+    return solver;
+}
+
+
+/**
+ * Reaches the private kernels of the solvers
+ */
+class SolverBenchmarks {
+public:
+
+    static void kernels(BenchCase const &c, BenchReport const &report) {
+        CounterRandom random(c.seed);
+
+        std::vector<double> x(c.numParticles * 3);
+        for (auto &value : x) value = random.uniform(-2.5, 2.5);
+
+        report("n", x.size(), bestOf(c.repeat, [&]() {
+            double sum = 0;
+            for (auto value : x) sum += SnowSolver::n(value);
+            sink = sum;
+        }));
+
+        report("del_n", x.size(), bestOf(c.repeat, [&]() {
+            double sum = 0;
+            for (auto value : x) sum += SnowSolver::del_n(value);
+            sink = sum;
+        }));
+    }
+
+    static void decompositions(BenchCase const &c, BenchReport const &report) {
+        CounterRandom random(c.seed);
+
+        // Deformation gradients near the identity, as in a settling scene
+        std::vector<glm::dmat3> m(c.numParticles);
+        for (auto &value : m) {
+            value = glm::dmat3(1);
+            for (auto i = 0; i < 3; i++) {
+                for (auto j = 0; j < 3; j++) value[i][j] += random.uniform(-0.1, 0.1);
+            }
+        }
+
+        report("svd", m.size(), bestOf(c.repeat, [&]() {
+            double sum = 0;
+            glm::dmat3 u, v;
+            glm::dvec3 e;
+            for (auto const &value : m) {
+                svd(value, u, e, v);
+                sum += e.x;
+            }
+            sink = sum;
+        }));
+
+        report("polar_rot", m.size(), bestOf(c.repeat, [&]() {
+            double sum = 0;
+            for (auto const &value : m) sum += polarRot(value)[0][0];
+            sink = sum;
+        }));
+
+        report("polar_decompose", m.size(), bestOf(c.repeat, [&]() {
+            double sum = 0;
+            glm::dmat3 r, s;
+            for (auto const &value : m) {
+                polarDecompose(value, r, s);
+                sum += s[0][0];
+            }
+            sink = sum;
+        }));
+    }
+
+    static void snowTransfers(BenchCase const &c, BenchReport const &report) {
+        std::unique_ptr<SnowSolver> solver(makeSnowSolver(c));
+        solver->update(); // Computes the particle volumes on the first tick
+
+        Profiler profiler;
+        solver->profiler = &profiler;
+        reportPhases("snow_", profiler, c, report, [&]() {
+            solver->update();
+        });
+    }
+
+    static void lavaTransfers(BenchCase const &c, BenchReport const &report) {
+        std::unique_ptr<LavaSolver> solver(makeLavaSolver(c));
+        solver->update();
+
+        Profiler profiler;
+        solver->profiler = &profiler;
+        reportPhases("lava_", profiler, c, report, [&]() {
+            solver->update();
+        });
+    }
+
+    static void velocityMatrix(BenchCase const &c, BenchReport const &report) {
+        std::unique_ptr<SnowSolver> solver(makeSnowSolver(c));
+        solver->update(); // Memoizes the weights the matrix reads
+
+        auto numGridNodes = solver->gridNodes.size();
+        std::vector<glm::dvec3> x(numGridNodes), Ax(numGridNodes);
+        for (auto i = 0; i < numGridNodes; i++) x[i] = solver->gridNodes[i].velocity_star;
+
+        report("velocity_matrix", solver->particleNodes.size(), bestOf(c.repeat, [&]() {
+            solver->implicitVelocityIntegrationMatrix(Ax, x);
+        }));
+
+        report("conjugate_residual", 1, bestOf(c.repeat, [&]() {
+            auto next = x;
+            sink = conjugateResidualSolver(solver.get(), &SnowSolver::implicitVelocityIntegrationMatrix, next, x,
+                                           c.iterations);
+        }));
+    }
+
+    static void pressureAndHeatMatrices(BenchCase const &c, BenchReport const &report) {
+        std::unique_ptr<LavaSolver> solver(makeLavaSolver(c));
+        solver->update(); // Classifies the cells and rasterizes their masses
+
+        auto numGridCellNodes = solver->gridCellNodes.size();
+        std::vector<double> x(numGridCellNodes), Ax(numGridCellNodes);
+        for (auto i = 0; i < numGridCellNodes; i++) x[i] = solver->gridCellNodes[i].temperature;
+
+        report("pressure_matrix", solver->interiorGridCellNodes.size(), bestOf(c.repeat, [&]() {
+            solver->implicitPressureIntegrationMatrix(Ax, x);
+        }));
+
+        report("heat_matrix", numGridCellNodes, bestOf(c.repeat, [&]() {
+            solver->implicitHeatIntegrationMatrix(Ax, x);
+        }));
+    }
+
+private:
+
+    /**
+     * Best time of the transfer phases of single updates
+     */
+    template<typename F>
+    static void reportPhases(std::string const &prefix, Profiler &profiler, BenchCase const &c,
+                             BenchReport const &report, F const &update) {
+        char const *phases[] = {"rasterize", "g2p"};
+        char const *names[] = {"p2g", "g2p"};
+        double best[] = {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+
+        for (auto r = 0u; r < c.repeat; r++) {
+            profiler.reset();
+            update();
+            for (auto const &phase : profiler.getPhases()) {
+                for (auto i = 0; i < 2; i++) {
+                    if (strcmp(phase.name, phases[i]) == 0 && phase.calls) best[i] = std::min(best[i], phase.seconds);
+                }
+            }
+        }
+
+        for (auto i = 0; i < 2; i++) report(prefix + names[i], c.numParticles, best[i]);
+    }
+
+};
+
+
+struct BenchGroup {
+    char const *name;
+    void (*run)(BenchCase const &c, BenchReport const &report);
+};
+
+static BenchGroup const benchGroups[] = {
+        {"kernels",              SolverBenchmarks::kernels},
+        {"decompositions",       SolverBenchmarks::decompositions},
+        {"snow_transfers",       SolverBenchmarks::snowTransfers},
+        {"lava_transfers",       SolverBenchmarks::lavaTransfers},
+        {"velocity_matrix",      SolverBenchmarks::velocityMatrix},
+        {"pressure_heat_matrix", SolverBenchmarks::pressureAndHeatMatrices},
+};
+
+
+template<typename T>
+static std::vector<T> parseList(char const *value) {
+    std::vector<T> list;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) list.push_back(static_cast<T>(std::stoull(item)));
+    }
+    return list;
+}
+
+static char const *findOption(int argc, char const **argv, char const *name) {
+    auto length = strlen(name);
+    for (auto i = 1; i < argc; i++) {
+        if (strncmp(argv[i], name, length) == 0 && argv[i][length] == '=') return argv[i] + length + 1;
+    }
+    return nullptr;
+}
+
+static void printResults(std::vector<BenchResult> const &results, std::string const &format, int threads) {
+    if (format == "json") {
+        std::cout << "[";
+        for (auto i = 0; i < results.size(); i++) {
+            auto const &r = results[i];
+            std::cout << (i ? ",\n" : "\n") << "  {\"benchmark\": \"" << r.benchmark << "\", \"particles\": "
+                      << r.numParticles << ", \"grid\": " << r.gridSize << ", \"threads\": " << threads
+                      << ", \"items\": " << r.items << ", \"seconds\": " << r.seconds << ", \"ns_per_item\": "
+                      << (r.items ? r.seconds * 1e9 / r.items : 0) << "}";
+        }
+        std::cout << "\n]" << std::endl;
+    } else {
+        std::cout << "benchmark,particles,grid,threads,items,seconds,ns_per_item\n";
+        for (auto const &r : results) {
+            std::cout << r.benchmark << "," << r.numParticles << "," << r.gridSize << "," << threads << ","
+                      << r.items << "," << r.seconds << "," << (r.items ? r.seconds * 1e9 / r.items : 0) << "\n";
+        }
+        std::cout.flush();
+    }
+}
+
+int main(int argc, char const **argv) {
+    BenchOptions options;
+
+    for (auto i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) {
+            std::cout << "Usage: snow_bench [--particles=n,...] [--grid=n,...] [--seed=s] [--repeat=r]"
+                      << " [--iterations=k] [--format=csv|json] [--filter=name]" << std::endl;
+            return 0;
+        }
+    }
+
+    if (auto value = findOption(argc, argv, "--particles")) options.particles = parseList<size_t>(value);
+    if (auto value = findOption(argc, argv, "--grid")) options.grids = parseList<unsigned int>(value);
+    if (auto value = findOption(argc, argv, "--seed")) options.seed = std::stoull(value);
+    if (auto value = findOption(argc, argv, "--repeat")) options.repeat = std::max(1, atoi(value));
+    if (auto value = findOption(argc, argv, "--iterations")) options.iterations = std::max(1, atoi(value));
+    if (auto value = findOption(argc, argv, "--format")) options.format = value;
+    if (auto value = findOption(argc, argv, "--filter")) options.filter = value;
+
+    if (options.format != "csv" && options.format != "json") {
+        std::cerr << "Unknown format " << options.format << std::endl;
+        return 1;
+    }
+
+#ifdef _OPENMP
+    auto threads = omp_get_max_threads();
+#else
+    auto threads = 1;
+#endif
+
+    std::vector<BenchResult> results;
+
+    for (auto numParticles : options.particles) {
+        for (auto gridSize : options.grids) {
+            BenchCase c{numParticles, gridSize, options.seed, options.repeat, options.iterations};
+
+            for (auto const &group : benchGroups) {
+                if (!options.filter.empty() && std::string(group.name).find(options.filter) == std::string::npos) {
+                    continue;
+                }
+
+                group.run(c, [&](std::string const &name, size_t items, double seconds) {
+                    results.push_back({name, numParticles, gridSize, items, seconds});
+                });
+            }
+        }
+    }
+
+    printResults(results, options.format, threads);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SNOW_COUNTERRANDOM_H
+#define SNOW_COUNTERRANDOM_H
+
+
+#include <cstdint>
+
+
+/**
+ * Counter-based random numbers, the n-th number of a seed is a hash of the seed and n alone
+ * Streams are the same on every platform, and can be split across threads by drawing at disjoint counters
+ */
+class CounterRandom {
+public:
+
+    explicit CounterRandom(uint64_t seed = 0, uint64_t counter = 0) : key(mix(seed)), counter(counter) {
+
+    }
+
+    /**
+     * Number at a counter, without advancing the stream
+     */
+    uint64_t at(uint64_t n) const {
+        return mix(key + (n + 1) * 0x9e3779b97f4a7c15ull);
+    }
+
+    uint64_t next() {
+        return at(counter++);
+    }
+
+    /**
+     * Uniform in [lo, hi), from the 53 high bits of the next number
+     */
+    double uniform(double lo, double hi) {
+        return lo + (hi - lo) * ((next() >> 11) * (1.0 / 9007199254740992.0));
+    }
+
+    uint64_t getCounter() const {
+        return counter;
+    }
+
+private:
+
+    uint64_t key;
+    uint64_t counter;
+
+    // SplitMix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+};
+
+
+#endif //SNOW_COUNTERRANDOM_H
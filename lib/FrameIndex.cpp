@@ -0,0 +1,83 @@
+#include "FrameIndex.h"
+
+#include <cstring>
+
+#include <unistd.h>
+
+
+bool FrameIndexWriter::open(std::string const &filename, uint32_t solver) {
+    close();
+
+    file = fopen(filename.c_str(), "ab+");
+    if (!file) return false;
+
+    FRAME_INDEX_HEADER header{};
+    fseek(file, 0, SEEK_END);
+    auto size = ftell(file);
+
+    if (size < static_cast<long>(sizeof(header))) {
+        // New index, or one whose header was cut short
+        fclose(file);
+        file = fopen(filename.c_str(), "wb");
+        if (!file) return false;
+
+        memcpy(header.magic, FRAME_INDEX_MAGIC, sizeof(header.magic));
+        header.version = FRAME_INDEX_VERSION;
+        header.solver = solver;
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    rewind(file);
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, FRAME_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version > FRAME_INDEX_VERSION || header.solver != solver) {
+        close();
+        return false;
+    }
+
+    // Records are appended whole, drop one cut short by a crash
+    auto records = (size - sizeof(header)) / sizeof(FRAME_INDEX_RECORD);
+    auto end = static_cast<long>(sizeof(header) + records * sizeof(FRAME_INDEX_RECORD));
+    if (end != size) {
+        fclose(file);
+        if (truncate(filename.c_str(), end) != 0) {
+            file = nullptr;
+            return false;
+        }
+        file = fopen(filename.c_str(), "ab");
+    } else if (fseek(file, 0, SEEK_END) != 0) { // Output may only follow input after repositioning the stream
+        close();
+        return false;
+    }
+
+    return file != nullptr;
+}
+
+bool FrameIndexWriter::append(FRAME_INDEX_RECORD const &record) {
+    return file && fwrite(&record, sizeof(record), 1, file) == 1 && fflush(file) == 0;
+}
+
+bool FrameIndexView::open(std::string const &filename) {
+    if (!file.open(filename)) return false;
+
+    if (file.size() < sizeof(FRAME_INDEX_HEADER) ||
+        memcmp(header().magic, FRAME_INDEX_MAGIC, sizeof(header().magic)) != 0 ||
+        header().version > FRAME_INDEX_VERSION) {
+        file.close();
+        return false;
+    }
+
+    return true;
+}
+
+FRAME_INDEX_RECORD const *FrameIndexView::find(uint32_t frame, uint32_t flags) const {
+    for (auto i = numRecords(); i > 0; i--) {
+        auto const &record = records()[i - 1];
+        if (record.frame == frame && record.flags == flags) return &record;
+    }
+    return nullptr;
+}
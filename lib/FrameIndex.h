@@ -0,0 +1,175 @@
+#ifndef SNOW_FRAMEINDEX_H
+#define SNOW_FRAMEINDEX_H
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+
+
+/**
+ * Frame index of a run directory
+ *
+ * A fixed header followed by one fixed-size record per frame written, appended once the frame is on disk. Tooling
+ * lists a run from the index alone, without opening any frame. A run resumed from an earlier frame appends its
+ * frames again, the last record of a frame is the current one. A record cut short by a crash is ignored.
+ */
+
+#define FRAME_INDEX_FILENAME "frames.index"
+#define FRAME_INDEX_MAGIC "SNFI"
+#define FRAME_INDEX_VERSION 1
+
+enum FrameIndexFlags {
+    FRAME_INDEX_CHECKPOINT = 1 // checkpoint-N rather than frame-N
+};
+
+struct FRAME_INDEX_HEADER {
+    char magic[4]; // FRAME_INDEX_MAGIC
+    uint32_t version;
+    uint32_t solver; // StateFileSolver
+    uint32_t reserved0;
+    uint64_t reserved1[2];
+};
+
+struct FRAME_INDEX_RECORD {
+    uint32_t frame;
+    uint32_t flags; // FrameIndexFlags
+    uint64_t tick;
+    double time;
+    uint64_t numParticles;
+    uint64_t bytes; // Of the frame file
+    uint64_t tableOffset; // Of the state file tables, within the frame file
+    double boundsMin[3]; // Of the particle positions
+    double boundsMax[3];
+    double kineticEnergy;
+    uint64_t ticks; // Since the previous frame, 0 if unknown
+    uint64_t reserved[2];
+};
+
+static_assert(sizeof(FRAME_INDEX_HEADER) == 32, "Frame index header must not be padded");
+static_assert(sizeof(FRAME_INDEX_RECORD) == 128, "Frame index record must not be padded");
+
+/**
+ * Fills the particle statistics of a record
+ */
+template<typename P>
+void computeFrameIndexStats(FRAME_INDEX_RECORD &record, std::vector<P> const &particleNodes) {
+    double minX = std::numeric_limits<double>::infinity(), minY = minX, minZ = minX;
+    double maxX = -minX, maxY = -minX, maxZ = -minX;
+    double kineticEnergy = 0;
+
+#pragma omp parallel for reduction(min:minX, minY, minZ) reduction(max:maxX, maxY, maxZ) reduction(+:kineticEnergy)
+    for (auto p = 0; p < particleNodes.size(); p++) {
+        auto const &particleNode = particleNodes[p];
+        minX = std::min(minX, particleNode.position.x);
+        minY = std::min(minY, particleNode.position.y);
+        minZ = std::min(minZ, particleNode.position.z);
+        maxX = std::max(maxX, particleNode.position.x);
+        maxY = std::max(maxY, particleNode.position.y);
+        maxZ = std::max(maxZ, particleNode.position.z);
+        kineticEnergy += 0.5 * particleNode.mass * glm::dot(particleNode.velocity, particleNode.velocity);
+    }
+
+    record.numParticles = particleNodes.size();
+    record.boundsMin[0] = minX;
+    record.boundsMin[1] = minY;
+    record.boundsMin[2] = minZ;
+    record.boundsMax[0] = maxX;
+    record.boundsMax[1] = maxY;
+    record.boundsMax[2] = maxZ;
+    record.kineticEnergy = kineticEnergy;
+}
+
+
+/**
+ * Appends records to a frame index, creating it if needed
+ */
+class FrameIndexWriter {
+public:
+
+    FrameIndexWriter() = default;
+
+    FrameIndexWriter(FrameIndexWriter const &) = delete;
+
+    FrameIndexWriter &operator=(FrameIndexWriter const &) = delete;
+
+    ~FrameIndexWriter() {
+        close();
+    }
+
+    /**
+     * Fails if the file cannot be opened or is the index of another solver
+     */
+    bool open(std::string const &filename, uint32_t solver);
+
+    void close() {
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    /**
+     * Appends and flushes a record, so readers see it as soon as the frame is on disk
+     */
+    bool append(FRAME_INDEX_RECORD const &record);
+
+private:
+
+    FILE *file = nullptr;
+
+};
+
+
+/**
+ * Read-only view of a frame index, mapped into memory
+ */
+class FrameIndexView {
+public:
+
+    FrameIndexView() = default;
+
+    explicit FrameIndexView(std::string const &filename) {
+        open(filename);
+    }
+
+    bool open(std::string const &filename);
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    FRAME_INDEX_HEADER const &header() const {
+        return *reinterpret_cast<FRAME_INDEX_HEADER const *>(file.data());
+    }
+
+    size_t numRecords() const {
+        return (file.size() - sizeof(FRAME_INDEX_HEADER)) / sizeof(FRAME_INDEX_RECORD);
+    }
+
+    FRAME_INDEX_RECORD const *records() const {
+        return reinterpret_cast<FRAME_INDEX_RECORD const *>(file.data() + sizeof(FRAME_INDEX_HEADER));
+    }
+
+    /**
+     * Last record of a frame, nullptr if it is not indexed
+     */
+    FRAME_INDEX_RECORD const *find(uint32_t frame, uint32_t flags = 0) const;
+
+private:
+
+    MappedFile file;
+
+};
+
+
+#endif //SNOW_FRAMEINDEX_H
@@ -2,22 +2,51 @@
 #define SNOW_LAVAGRIDFACENODE_H
 
 
-#include "Node.h"
+#include <algorithm>
+#include <vector>
 
 
-struct LavaGridFaceNode : public Node {
+/**
+ * Staggered grid faces along one axis, stored as one array per quantity
+ * A face only carries the velocity component normal to it
+ */
+struct LavaGridFaceNodes {
 
-    LavaGridFaceNode(glm::dvec3 const &position, glm::uvec3 const &location) : Node(position), location(location) {}
+    std::vector<double> mass;
 
-    glm::uvec3 location;
+    std::vector<double> velocity;
+    std::vector<double> velocity_star; // Intermediate velocity (for collision handling)
 
-    double force{};
+    std::vector<double> force;
 
-    double thermalConductivity{};
+    std::vector<double> thermalConductivity;
 
-    bool colliding{};
+    std::vector<double> inv_density;
 
-    double inv_density{};
+    std::vector<unsigned char> colliding;
+    std::vector<unsigned char> occupied; // mass > 0 as of the last classification
+
+    size_t size() const {
+        return mass.size();
+    }
+
+    /**
+     * Bytes held by the arrays, or needed for count faces if that is more
+     */
+    size_t memoryUsage(size_t count) const {
+        return std::max(count, mass.capacity()) * (6 * sizeof(double) + 2 * sizeof(unsigned char));
+    }
+
+    void reset(size_t count) {
+        mass.assign(count, 0);
+        velocity.assign(count, 0);
+        velocity_star.assign(count, 0);
+        force.assign(count, 0);
+        thermalConductivity.assign(count, 0);
+        inv_density.assign(count, 0);
+        colliding.assign(count, 0);
+        occupied.assign(count, 0);
+    }
 
 };
 
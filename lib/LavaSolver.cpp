@@ -1,15 +1,13 @@
 #include "LavaSolver.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 
 #include <glm/gtc/type_ptr.hpp>
-#include <Dense>
 
 #include "conjugate_residual_solver.h"
-
-
-typedef Eigen::Matrix<double, 3, 3> eigen_matrix3;
-typedef Eigen::Matrix<double, 3, 1> eigen_vector3;
+#include "svd.h"
 
 
 LavaSolver::LavaSolver(double h, glm::uvec3 const &size) : h(h), size(size) {
@@ -20,36 +18,6 @@ LavaSolver::LavaSolver(std::string const &filename) {
     loadState(filename);
 }
 
-inline void svd(glm::dmat3 const &m, glm::dmat3 &u, glm::dvec3 &e, glm::dmat3 &v) {
-    Eigen::Map<eigen_matrix3 const> mmap(glm::value_ptr(m));
-    Eigen::Map<eigen_matrix3> umap(glm::value_ptr(u));
-    Eigen::Map<eigen_vector3> emap(glm::value_ptr(e));
-    Eigen::Map<eigen_matrix3> vmap(glm::value_ptr(v));
-
-    Eigen::JacobiSVD<eigen_matrix3, Eigen::NoQRPreconditioner> svd;
-    svd.compute(mmap, Eigen::ComputeFullV | Eigen::ComputeFullU);
-    umap = svd.matrixU();
-    emap = svd.singularValues();
-    vmap = svd.matrixV();
-}
-
-inline glm::dmat3 polarRot(glm::dmat3 const &m) {
-    glm::dmat3 u;
-    glm::dvec3 e;
-    glm::dmat3 v;
-    svd(m, u, e, v);
-    return u * glm::transpose(v);
-}
-
-inline void polarDecompose(glm::dmat3 const &m, glm::dmat3 &r, glm::dmat3 &s) {
-    glm::dmat3 u;
-    glm::dvec3 e;
-    glm::dmat3 v;
-    svd(m, u, e, v);
-    r = u * glm::transpose(v);
-    s = v * glm::dmat3(e.x, 0, 0, 0, e.y, 0, 0, 0, e.z) * glm::transpose(v);
-}
-
 glm::dmat3 deformationUpdateR(glm::dmat3 m) {
     if (glm::determinant(glm::dmat3(1) + m) > 0) {
         return glm::dmat3(1) + m;
@@ -64,6 +32,7 @@ void LavaSolver::propagateSimulationParametersUpdate() {
     invh = 1 / h;
 
     gridCellNodes.clear();
+    gridCellNodes.reserve(size.x * size.y * size.z);
     for (auto x = 0; x < size.x; x++) {
         for (auto y = 0; y < size.y; y++) {
             for (auto z = 0; z < size.z; z++) {
@@ -72,32 +41,14 @@ void LavaSolver::propagateSimulationParametersUpdate() {
         }
     }
 
-    gridFaceXNodes.clear();
-    for (auto x = 0; x <= size.x; x++) {
-        for (auto y = 0; y < size.y; y++) {
-            for (auto z = 0; z < size.z; z++) {
-                gridFaceXNodes.emplace_back(glm::dvec3(x - 0.5, y, z) * h, glm::uvec3(x, y, z));
-            }
-        }
-    }
-
-    gridFaceYNodes.clear();
-    for (auto x = 0; x < size.x; x++) {
-        for (auto y = 0; y <= size.y; y++) {
-            for (auto z = 0; z < size.z; z++) {
-                gridFaceYNodes.emplace_back(glm::dvec3(x, y - 0.5, z) * h, glm::uvec3(x, y, z));
-            }
-        }
-    }
+    gridFaceXNodes.reset((size.x + 1) * size.y * size.z);
+    gridFaceYNodes.reset(size.x * (size.y + 1) * size.z);
+    gridFaceZNodes.reset(size.x * size.y * (size.z + 1));
 
-    gridFaceZNodes.clear();
-    for (auto x = 0; x < size.x; x++) {
-        for (auto y = 0; y < size.y; y++) {
-            for (auto z = 0; z <= size.z; z++) {
-                gridFaceZNodes.emplace_back(glm::dvec3(x, y, z - 0.5) * h, glm::uvec3(x, y, z));
-            }
-        }
-    }
+    // Freshly built grid: every cell is EMPTY and every face unoccupied, so classification restarts from scratch
+    dirtyGridCellNodes.clear();
+    collidingGridCellNodes.clear();
+    interiorGridCellNodes.clear();
 
     LOG(INFO) << "size=" << size << std::endl;
     LOG(INFO) << "#gridCellNodes=" << gridCellNodes.size() << std::endl;
@@ -106,6 +57,95 @@ void LavaSolver::propagateSimulationParametersUpdate() {
     LOG(INFO) << "#gridFaceZNodes=" << gridFaceZNodes.size() << std::endl;
 }
 
+void LavaSolver::markGridFaceXNodeCells(unsigned int x, unsigned int y, unsigned int z) {
+    if (x > 0) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x - 1, y, z));
+    if (x < size.x) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x, y, z));
+}
+
+void LavaSolver::markGridFaceYNodeCells(unsigned int x, unsigned int y, unsigned int z) {
+    if (y > 0) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x, y - 1, z));
+    if (y < size.y) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x, y, z));
+}
+
+void LavaSolver::markGridFaceZNodeCells(unsigned int x, unsigned int y, unsigned int z) {
+    if (z > 0) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x, y, z - 1));
+    if (z < size.z) dirtyGridCellNodes.push_back(getGridCellNodeIndex(x, y, z));
+}
+
+LavaGridCellNodeType LavaSolver::classifyGridCellNode(LavaGridCellNode const &cellNode) {
+    auto const &location = cellNode.location;
+
+    unsigned int faceXNodes[2] = {getGridFaceXNodeIndex(location.x, location.y, location.z),
+                                  getGridFaceXNodeIndex(location.x + 1, location.y, location.z)};
+    unsigned int faceYNodes[2] = {getGridFaceYNodeIndex(location.x, location.y, location.z),
+                                  getGridFaceYNodeIndex(location.x, location.y + 1, location.z)};
+    unsigned int faceZNodes[2] = {getGridFaceZNodeIndex(location.x, location.y, location.z),
+                                  getGridFaceZNodeIndex(location.x, location.y, location.z + 1)};
+
+    auto cellColliding = true;
+    auto cellInterior = true;
+
+    for (auto f : faceXNodes) {
+        cellColliding &= gridFaceXNodes.colliding[f] != 0;
+        cellInterior &= gridFaceXNodes.occupied[f] != 0;
+    }
+    for (auto f : faceYNodes) {
+        cellColliding &= gridFaceYNodes.colliding[f] != 0;
+        cellInterior &= gridFaceYNodes.occupied[f] != 0;
+    }
+    for (auto f : faceZNodes) {
+        cellColliding &= gridFaceZNodes.colliding[f] != 0;
+        cellInterior &= gridFaceZNodes.occupied[f] != 0;
+    }
+
+    if (cellColliding) return COLLIDING;
+    if (cellInterior) return INTERIOR;
+    return EMPTY;
+}
+
+void LavaSolver::classifyGridCellNodes() {
+
+    // A cell's type only depends on its six faces, so only cells next to a face that changed need to be revisited
+
+    std::sort(dirtyGridCellNodes.begin(), dirtyGridCellNodes.end());
+    dirtyGridCellNodes.erase(std::unique(dirtyGridCellNodes.begin(), dirtyGridCellNodes.end()),
+                             dirtyGridCellNodes.end());
+
+    std::vector<unsigned int> newlyColliding;
+    std::vector<unsigned int> newlyInterior;
+
+    for (auto c : dirtyGridCellNodes) {
+        auto &cellNode = gridCellNodes[c];
+
+        auto type = classifyGridCellNode(cellNode);
+        if (type == cellNode.type) continue;
+
+        if (type == COLLIDING) newlyColliding.push_back(c);
+        else if (type == INTERIOR) newlyInterior.push_back(c);
+
+        cellNode.type = type;
+    }
+
+    dirtyGridCellNodes.clear();
+
+    // Drop cells that were reclassified away, then append the new arrivals
+
+    collidingGridCellNodes.erase(std::remove_if(collidingGridCellNodes.begin(), collidingGridCellNodes.end(),
+                                                [this](unsigned int c) {
+                                                    return gridCellNodes[c].type != COLLIDING;
+                                                }),
+                                 collidingGridCellNodes.end());
+    collidingGridCellNodes.insert(collidingGridCellNodes.end(), newlyColliding.begin(), newlyColliding.end());
+
+    interiorGridCellNodes.erase(std::remove_if(interiorGridCellNodes.begin(), interiorGridCellNodes.end(),
+                                               [this](unsigned int c) {
+                                                   return gridCellNodes[c].type != INTERIOR;
+                                               }),
+                                interiorGridCellNodes.end());
+    interiorGridCellNodes.insert(interiorGridCellNodes.end(), newlyInterior.begin(), newlyInterior.end());
+
+}
+
 inline double ddot(glm::dmat3 a, glm::dmat3 b) {
     return a[0][0] * b[0][0] + a[0][1] * b[0][1] + a[0][2] * b[0][2] +
            a[1][0] * b[1][0] + a[1][1] * b[1][1] + a[1][2] * b[1][2] +
@@ -115,7 +155,10 @@ inline double ddot(glm::dmat3 a, glm::dmat3 b) {
 void LavaSolver::update() {
     LOG(INFO) << "delta_t=" << delta_t << " tick=" << tick << std::endl;
 
+    ProfilerScope phase(profiler);
+
     if (simulationParametersDidUpdate) {
+        phase.next("setup");
         propagateSimulationParametersUpdate();
     }
 
@@ -127,6 +170,8 @@ void LavaSolver::update() {
 
     // 3. Rasterize particle data to grid //////////////////////////////////////////////////////////////////////////////
 
+    phase.next("rasterize");
+
     // Clear cell nodes
     for (auto i = 0; i < numGridCellNodes; i++) {
         auto &cellNode = gridCellNodes[i];
@@ -140,29 +185,11 @@ void LavaSolver::update() {
 
     }
     // Clear face nodes
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &faceNode = gridFaceXNodes[i];
-
-        faceNode.mass = 0;
-        faceNode.velocity = {};
-        faceNode.thermalConductivity = 0;
-        faceNode.inv_density = 0;
-    }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &faceNode = gridFaceYNodes[i];
-
-        faceNode.mass = 0;
-        faceNode.velocity = {};
-        faceNode.thermalConductivity = 0;
-        faceNode.inv_density = 0;
-    }
-    for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &faceNode = gridFaceZNodes[i];
-
-        faceNode.mass = 0;
-        faceNode.velocity = {};
-        faceNode.thermalConductivity = 0;
-        faceNode.inv_density = 0;
+    for (auto faceNodes : {&gridFaceXNodes, &gridFaceYNodes, &gridFaceZNodes}) {
+        std::fill(faceNodes->mass.begin(), faceNodes->mass.end(), 0);
+        std::fill(faceNodes->velocity.begin(), faceNodes->velocity.end(), 0);
+        std::fill(faceNodes->thermalConductivity.begin(), faceNodes->thermalConductivity.end(), 0);
+        std::fill(faceNodes->inv_density.begin(), faceNodes->inv_density.end(), 0);
     }
 
     for (auto p = 0; p < numParticleNodes; p++) {
@@ -209,51 +236,54 @@ void LavaSolver::update() {
             auto gy = gfxmin.y + (i / 4) % 4;
             auto gz = gfxmin.z + i % 4;
             if (!isValidGridFaceXNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceXNode(gx, gy, gz);
+            auto f = getGridFaceXNodeIndex(gx, gy, gz);
+            auto facePosition = getGridFaceXNodePosition(gx, gy, gz);
 
             // Pre-compute weights
-            particleNode.face_x_weight[i] = weight(faceNode, particleNode);
-            particleNode.face_x_nabla_weight[i] = nabla_weight(faceNode, particleNode);
+            particleNode.face_x_weight[i] = n(facePosition, particleNode.position);
+            particleNode.face_x_nabla_weight[i] = nabla_n(facePosition, particleNode.position);
 
             auto particleWeightedMass = particleNode.mass * particleNode.face_x_weight[i];
 
-            faceNode.mass += particleWeightedMass;
-            faceNode.velocity.x += particleNode.velocity.x * particleWeightedMass;
-            faceNode.thermalConductivity += particleNode.thermalConductivity * particleWeightedMass;
+            gridFaceXNodes.mass[f] += particleWeightedMass;
+            gridFaceXNodes.velocity[f] += particleNode.velocity.x * particleWeightedMass;
+            gridFaceXNodes.thermalConductivity[f] += particleNode.thermalConductivity * particleWeightedMass;
         }
         for (unsigned int i = 0; i < 64; i++) {
             auto gx = gfymin.x + i / 16;
             auto gy = gfymin.y + (i / 4) % 4;
             auto gz = gfymin.z + i % 4;
             if (!isValidGridFaceYNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceYNode(gx, gy, gz);
+            auto f = getGridFaceYNodeIndex(gx, gy, gz);
+            auto facePosition = getGridFaceYNodePosition(gx, gy, gz);
 
             // Pre-compute weights
-            particleNode.face_y_weight[i] = weight(faceNode, particleNode);
-            particleNode.face_y_nabla_weight[i] = nabla_weight(faceNode, particleNode);
+            particleNode.face_y_weight[i] = n(facePosition, particleNode.position);
+            particleNode.face_y_nabla_weight[i] = nabla_n(facePosition, particleNode.position);
 
             auto particleWeightedMass = particleNode.mass * particleNode.face_y_weight[i];
 
-            faceNode.mass += particleWeightedMass;
-            faceNode.velocity.y += particleNode.velocity.y * particleWeightedMass;
-            faceNode.thermalConductivity += particleNode.thermalConductivity * particleWeightedMass;
+            gridFaceYNodes.mass[f] += particleWeightedMass;
+            gridFaceYNodes.velocity[f] += particleNode.velocity.y * particleWeightedMass;
+            gridFaceYNodes.thermalConductivity[f] += particleNode.thermalConductivity * particleWeightedMass;
         }
         for (unsigned int i = 0; i < 64; i++) {
             auto gx = gfzmin.x + i / 16;
             auto gy = gfzmin.y + (i / 4) % 4;
             auto gz = gfzmin.z + i % 4;
             if (!isValidGridFaceZNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceZNode(gx, gy, gz);
+            auto f = getGridFaceZNodeIndex(gx, gy, gz);
+            auto facePosition = getGridFaceZNodePosition(gx, gy, gz);
 
             // Pre-compute weights
-            particleNode.face_z_weight[i] = weight(faceNode, particleNode);
-            particleNode.face_z_nabla_weight[i] = nabla_weight(faceNode, particleNode);
+            particleNode.face_z_weight[i] = n(facePosition, particleNode.position);
+            particleNode.face_z_nabla_weight[i] = nabla_n(facePosition, particleNode.position);
 
             auto particleWeightedMass = particleNode.mass * particleNode.face_z_weight[i];
 
-            faceNode.mass += particleWeightedMass;
-            faceNode.velocity.z += particleNode.velocity.z * particleWeightedMass;
-            faceNode.thermalConductivity += particleNode.thermalConductivity * particleWeightedMass;
+            gridFaceZNodes.mass[f] += particleWeightedMass;
+            gridFaceZNodes.velocity[f] += particleNode.velocity.z * particleWeightedMass;
+            gridFaceZNodes.thermalConductivity[f] += particleNode.thermalConductivity * particleWeightedMass;
         }
 
     }
@@ -278,44 +308,77 @@ void LavaSolver::update() {
         }
     }
 
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &gridFaceNode = gridFaceXNodes[i];
-
-        if (gridFaceNode.mass > 0) {
-            gridFaceNode.velocity /= gridFaceNode.mass;
-            gridFaceNode.thermalConductivity /= gridFaceNode.mass;
-        } else {
-            gridFaceNode.velocity = {};
-            gridFaceNode.thermalConductivity = 0;
+    for (auto x = 0; x <= size.x; x++) {
+        for (auto y = 0; y < size.y; y++) {
+            for (auto z = 0; z < size.z; z++) {
+                auto f = getGridFaceXNodeIndex(x, y, z);
+                auto &faceNodes = gridFaceXNodes;
+
+                if (faceNodes.mass[f] > 0) {
+                    faceNodes.velocity[f] /= faceNodes.mass[f];
+                    faceNodes.thermalConductivity[f] /= faceNodes.mass[f];
+                } else {
+                    faceNodes.velocity[f] = 0;
+                    faceNodes.thermalConductivity[f] = 0;
+                }
+
+                unsigned char colliding = isGridFaceNodeColliding(getGridFaceXNodePosition(x, y, z));
+                unsigned char occupied = faceNodes.mass[f] > 0;
+                if (colliding != faceNodes.colliding[f] || occupied != faceNodes.occupied[f]) {
+                    faceNodes.colliding[f] = colliding;
+                    faceNodes.occupied[f] = occupied;
+                    markGridFaceXNodeCells(x, y, z);
+                }
+            }
         }
-
-        gridFaceNode.colliding = isNodeColliding(gridFaceNode);
     }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &gridFaceNode = gridFaceYNodes[i];
-
-        if (gridFaceNode.mass > 0) {
-            gridFaceNode.velocity /= gridFaceNode.mass;
-            gridFaceNode.thermalConductivity /= gridFaceNode.mass;
-        } else {
-            gridFaceNode.velocity = {};
-            gridFaceNode.thermalConductivity = 0;
+    for (auto x = 0; x < size.x; x++) {
+        for (auto y = 0; y <= size.y; y++) {
+            for (auto z = 0; z < size.z; z++) {
+                auto f = getGridFaceYNodeIndex(x, y, z);
+                auto &faceNodes = gridFaceYNodes;
+
+                if (faceNodes.mass[f] > 0) {
+                    faceNodes.velocity[f] /= faceNodes.mass[f];
+                    faceNodes.thermalConductivity[f] /= faceNodes.mass[f];
+                } else {
+                    faceNodes.velocity[f] = 0;
+                    faceNodes.thermalConductivity[f] = 0;
+                }
+
+                unsigned char colliding = isGridFaceNodeColliding(getGridFaceYNodePosition(x, y, z));
+                unsigned char occupied = faceNodes.mass[f] > 0;
+                if (colliding != faceNodes.colliding[f] || occupied != faceNodes.occupied[f]) {
+                    faceNodes.colliding[f] = colliding;
+                    faceNodes.occupied[f] = occupied;
+                    markGridFaceYNodeCells(x, y, z);
+                }
+            }
         }
-
-        gridFaceNode.colliding = isNodeColliding(gridFaceNode);
     }
-    for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &gridFaceNode = gridFaceZNodes[i];
-
-        if (gridFaceNode.mass > 0) {
-            gridFaceNode.velocity /= gridFaceNode.mass;
-            gridFaceNode.thermalConductivity /= gridFaceNode.mass;
-        } else {
-            gridFaceNode.velocity = {};
-            gridFaceNode.thermalConductivity = 0;
+    for (auto x = 0; x < size.x; x++) {
+        for (auto y = 0; y < size.y; y++) {
+            for (auto z = 0; z <= size.z; z++) {
+                auto f = getGridFaceZNodeIndex(x, y, z);
+                auto &faceNodes = gridFaceZNodes;
+
+                if (faceNodes.mass[f] > 0) {
+                    faceNodes.velocity[f] /= faceNodes.mass[f];
+                    faceNodes.thermalConductivity[f] /= faceNodes.mass[f];
+                } else {
+                    faceNodes.velocity[f] = 0;
+                    faceNodes.thermalConductivity[f] = 0;
+                }
+
+                unsigned char colliding = isGridFaceNodeColliding(getGridFaceZNodePosition(x, y, z));
+                unsigned char occupied = faceNodes.mass[f] > 0;
+                if (colliding != faceNodes.colliding[f] || occupied != faceNodes.occupied[f]) {
+                    faceNodes.colliding[f] = colliding;
+                    faceNodes.occupied[f] = occupied;
+                    markGridFaceZNodeCells(x, y, z);
+                }
+            }
         }
-
-        gridFaceNode.colliding = isNodeColliding(gridFaceNode);
     }
 
     // Compute particle volumes and densities
@@ -347,77 +410,28 @@ void LavaSolver::update() {
 
     // 4. Classify cells ///////////////////////////////////////////////////////////////////////////////////////////////
 
-    int numGellNodesColliding = 0;
-
-    for (auto i = 0; i < numGridCellNodes; i++) {
-        auto &cellNode = gridCellNodes[i];
-
-        auto cellColliding = true;
-        auto cellInterior = true;
+    phase.next("classify");
 
-        {
-            auto face = gridFaceXNode(cellNode.location);
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
-        {
-            auto face = gridFaceXNode(cellNode.location + glm::uvec3(1, 0, 0));
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
-        {
-            auto face = gridFaceYNode(cellNode.location);
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
-        {
-            auto face = gridFaceYNode(cellNode.location + glm::uvec3(0, 1, 0));
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
-        {
-            auto face = gridFaceZNode(cellNode.location);
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
-        {
-            auto face = gridFaceZNode(cellNode.location + glm::uvec3(0, 0, 1));
-            cellColliding &= face.colliding;
-            cellInterior &= face.mass > 0;
-        }
+    classifyGridCellNodes();
 
-        if (cellColliding) {
-            cellNode.type = COLLIDING;
-            cellNode.temperature = 200; // FIXME: Hard coded hot colliding surface
-            numGellNodesColliding++;
-        } else if (cellInterior) {
-            cellNode.type = INTERIOR;
-        } else {
-            cellNode.type = EMPTY;
-        }
+    for (auto c : collidingGridCellNodes) {
+        gridCellNodes[c].temperature = 200; // FIXME: Hard coded hot colliding surface
     }
 
-    LOG(INFO) << "numCellNodesColliding=" << numGellNodesColliding << std::endl;
+    LOG(INFO) << "numCellNodesColliding=" << collidingGridCellNodes.size()
+              << " numCellNodesInterior=" << interiorGridCellNodes.size() << std::endl;
 
     // 5. MPM velocity update //////////////////////////////////////////////////////////////////////////////////////////
 
+    phase.next("forces");
+
     // TODO: Follow actual equation (23) for velocity explicit update
 
     // Clear face nodes
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &faceNode = gridFaceXNodes[i];
-
-        faceNode.force = 0;
-    }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &faceNode = gridFaceYNodes[i];
-
-        faceNode.force = 0;
-    }
+    std::fill(gridFaceXNodes.force.begin(), gridFaceXNodes.force.end(), 0);
+    std::fill(gridFaceYNodes.force.begin(), gridFaceYNodes.force.end(), 0);
     for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &faceNode = gridFaceZNodes[i];
-
-        faceNode.force = -9.8 * faceNode.mass;
+        gridFaceZNodes.force[i] = -9.8 * gridFaceZNodes.mass[i];
     }
 
     // Transfer particle forces to faces
@@ -465,83 +479,85 @@ void LavaSolver::update() {
             auto gy = gfxmin.y + (i / 4) % 4;
             auto gz = gfxmin.z + i % 4;
             if (!isValidGridFaceXNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceXNode(gx, gy, gz);
 
-            faceNode.force += (unweightedForce * particleNode.face_x_nabla_weight[i]).x;
+            gridFaceXNodes.force[getGridFaceXNodeIndex(gx, gy, gz)] +=
+                    (unweightedForce * particleNode.face_x_nabla_weight[i]).x;
         }
         for (unsigned int i = 0; i < 64; i++) {
             auto gx = gfymin.x + i / 16;
             auto gy = gfymin.y + (i / 4) % 4;
             auto gz = gfymin.z + i % 4;
             if (!isValidGridFaceYNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceYNode(gx, gy, gz);
 
-            faceNode.force += (unweightedForce * particleNode.face_y_nabla_weight[i]).y;
+            gridFaceYNodes.force[getGridFaceYNodeIndex(gx, gy, gz)] +=
+                    (unweightedForce * particleNode.face_y_nabla_weight[i]).y;
         }
         for (unsigned int i = 0; i < 64; i++) {
             auto gx = gfzmin.x + i / 16;
             auto gy = gfzmin.y + (i / 4) % 4;
             auto gz = gfzmin.z + i % 4;
             if (!isValidGridFaceZNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceZNode(gx, gy, gz);
 
-            faceNode.force += (unweightedForce * particleNode.face_z_nabla_weight[i]).z;
+            gridFaceZNodes.force[getGridFaceZNodeIndex(gx, gy, gz)] +=
+                    (unweightedForce * particleNode.face_z_nabla_weight[i]).z;
         }
 
     }
 
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &faceNode = gridFaceXNodes[i];
-
-        if (faceNode.force != 0 && faceNode.mass > 0) {
-            faceNode.velocity_star = faceNode.velocity + delta_t * faceNode.force / faceNode.mass;
-        } else {
-            faceNode.velocity_star = {};
-        }
-    }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &faceNode = gridFaceYNodes[i];
-
-        if (faceNode.force != 0 && faceNode.mass > 0) {
-            faceNode.velocity_star = faceNode.velocity + delta_t * faceNode.force / faceNode.mass;
-        } else {
-            faceNode.velocity_star = {};
-        }
-    }
-    for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &faceNode = gridFaceZNodes[i];
-
-        if (faceNode.force != 0 && faceNode.mass > 0) {
-            faceNode.velocity_star = faceNode.velocity + delta_t * faceNode.force / faceNode.mass;
-        } else {
-            faceNode.velocity_star = {};
+    for (auto faceNodes : {&gridFaceXNodes, &gridFaceYNodes, &gridFaceZNodes}) {
+        for (auto i = 0; i < faceNodes->size(); i++) {
+            if (faceNodes->force[i] != 0 && faceNodes->mass[i] > 0) {
+                faceNodes->velocity_star[i] =
+                        faceNodes->velocity[i] + delta_t * faceNodes->force[i] / faceNodes->mass[i];
+            } else {
+                faceNodes->velocity_star[i] = 0;
+            }
         }
     }
 
     // 6. Process grid collisions //////////////////////////////////////////////////////////////////////////////////////
 
+    phase.next("collisions");
+
     if (handleNodeCollisionVelocityUpdate) {
 
-        for (auto i = 0; i < numGridFaceXNodes; i++) {
-            auto &faceNode = gridFaceXNodes[i];
+        for (auto x = 0; x <= size.x; x++) {
+            for (auto y = 0; y < size.y; y++) {
+                for (auto z = 0; z < size.z; z++) {
+                    auto f = getGridFaceXNodeIndex(x, y, z);
 
-            handleNodeCollisionVelocityUpdate(faceNode);
+                    gridFaceXNodes.velocity_star[f] = handleGridFaceNodeCollisionVelocityUpdate(
+                            getGridFaceXNodePosition(x, y, z), 0, gridFaceXNodes.velocity_star[f]);
+                }
+            }
         }
-        for (auto i = 0; i < numGridFaceYNodes; i++) {
-            auto &faceNode = gridFaceYNodes[i];
-
-            handleNodeCollisionVelocityUpdate(faceNode);
+        for (auto x = 0; x < size.x; x++) {
+            for (auto y = 0; y <= size.y; y++) {
+                for (auto z = 0; z < size.z; z++) {
+                    auto f = getGridFaceYNodeIndex(x, y, z);
+
+                    gridFaceYNodes.velocity_star[f] = handleGridFaceNodeCollisionVelocityUpdate(
+                            getGridFaceYNodePosition(x, y, z), 1, gridFaceYNodes.velocity_star[f]);
+                }
+            }
         }
-        for (auto i = 0; i < numGridFaceZNodes; i++) {
-            auto &faceNode = gridFaceZNodes[i];
-
-            handleNodeCollisionVelocityUpdate(faceNode);
+        for (auto x = 0; x < size.x; x++) {
+            for (auto y = 0; y < size.y; y++) {
+                for (auto z = 0; z <= size.z; z++) {
+                    auto f = getGridFaceZNodeIndex(x, y, z);
+
+                    gridFaceZNodes.velocity_star[f] = handleGridFaceNodeCollisionVelocityUpdate(
+                            getGridFaceZNodePosition(x, y, z), 2, gridFaceZNodes.velocity_star[f]);
+                }
+            }
         }
 
     }
 
     // 7. Project velocities ///////////////////////////////////////////////////////////////////////////////////////////
 
+    phase.next("projection");
+
     std::vector<double> next_quantity(numGridCellNodes);
     std::vector<double> quantity(numGridCellNodes);
 
@@ -565,16 +581,19 @@ void LavaSolver::update() {
             if (cellNode.type != INTERIOR) continue;
 
             {
-                auto &faceNode = gridFaceXNode(cellNode.location.x, cellNode.location.y, cellNode.location.z);
-                faceNode.inv_density += weight(faceNode, particleNode);
+                auto const &location = cellNode.location;
+                gridFaceXNodes.inv_density[getGridFaceXNodeIndex(location.x, location.y, location.z)] +=
+                        n(getGridFaceXNodePosition(location.x, location.y, location.z), particleNode.position);
             }
             {
-                auto &faceNode = gridFaceYNode(cellNode.location.x, cellNode.location.y, cellNode.location.z);
-                faceNode.inv_density += weight(faceNode, particleNode);
+                auto const &location = cellNode.location;
+                gridFaceYNodes.inv_density[getGridFaceYNodeIndex(location.x, location.y, location.z)] +=
+                        n(getGridFaceYNodePosition(location.x, location.y, location.z), particleNode.position);
             }
             {
-                auto &faceNode = gridFaceZNode(cellNode.location.x, cellNode.location.y, cellNode.location.z);
-                faceNode.inv_density += weight(faceNode, particleNode);
+                auto const &location = cellNode.location;
+                gridFaceZNodes.inv_density[getGridFaceZNodeIndex(location.x, location.y, location.z)] +=
+                        n(getGridFaceZNodePosition(location.x, location.y, location.z), particleNode.position);
             }
 
         }
@@ -583,53 +602,33 @@ void LavaSolver::update() {
 
     // Density
 
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &faceNode = gridFaceXNodes[i];
-
-        if (faceNode.mass > 0) {
-            faceNode.inv_density *= pow(h, 3) / faceNode.mass;
-        } else {
-            faceNode.inv_density = 0;
-        }
-    }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &faceNode = gridFaceYNodes[i];
-
-        if (faceNode.mass > 0) {
-            faceNode.inv_density *= pow(h, 3) / faceNode.mass;
-        } else {
-            faceNode.inv_density = 0;
-        }
-    }
-    for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &faceNode = gridFaceZNodes[i];
-
-        if (faceNode.mass > 0) {
-            faceNode.inv_density *= pow(h, 3) / faceNode.mass;
-        } else {
-            faceNode.inv_density = 0;
+    for (auto faceNodes : {&gridFaceXNodes, &gridFaceYNodes, &gridFaceZNodes}) {
+        for (auto i = 0; i < faceNodes->size(); i++) {
+            if (faceNodes->mass[i] > 0) {
+                faceNodes->inv_density[i] *= pow(h, 3) / faceNodes->mass[i];
+            } else {
+                faceNodes->inv_density[i] = 0;
+            }
         }
     }
 
-    for (auto c = 0; c < numGridCellNodes; c++) {
+    // Non-interior cells keep the zero they were initialized with
+    for (auto c : interiorGridCellNodes) {
         auto &cellNode = gridCellNodes[c];
 
         // Skip no mass node
-        if (cellNode.type != INTERIOR || cellNode.mass == 0) {
-            quantity[c] = 0;
-            next_quantity[c] = 0;
-            continue;
-        }
+        if (cellNode.mass == 0) continue;
 
         // Compute s_c
 
+        auto const &location = cellNode.location;
         auto s_c = -(cellNode.je - 1) / (delta_t * cellNode.je) -
-                   (gridFaceXNode(cellNode.location.x + 1, cellNode.location.y, cellNode.location.z).velocity_star.x -
-                    gridFaceXNode(cellNode.location.x, cellNode.location.y, cellNode.location.z).velocity_star.x +
-                    gridFaceYNode(cellNode.location.x, cellNode.location.y + 1, cellNode.location.z).velocity_star.y -
-                    gridFaceYNode(cellNode.location.x, cellNode.location.y, cellNode.location.z).velocity_star.y +
-                    gridFaceZNode(cellNode.location.x, cellNode.location.y, cellNode.location.z + 1).velocity_star.z -
-                    gridFaceZNode(cellNode.location.x, cellNode.location.y, cellNode.location.z).velocity_star.z);
+                   (gridFaceXNodes.velocity_star[getGridFaceXNodeIndex(location.x + 1, location.y, location.z)] -
+                    gridFaceXNodes.velocity_star[getGridFaceXNodeIndex(location.x, location.y, location.z)] +
+                    gridFaceYNodes.velocity_star[getGridFaceYNodeIndex(location.x, location.y + 1, location.z)] -
+                    gridFaceYNodes.velocity_star[getGridFaceYNodeIndex(location.x, location.y, location.z)] +
+                    gridFaceZNodes.velocity_star[getGridFaceZNodeIndex(location.x, location.y, location.z + 1)] -
+                    gridFaceZNodes.velocity_star[getGridFaceZNodeIndex(location.x, location.y, location.z)]);
 
         quantity[c] = s_c;
         next_quantity[c] = -1.0 / cellNode.jp / cellNode.inv_lambda * (cellNode.je - 1);
@@ -637,91 +636,59 @@ void LavaSolver::update() {
 
     }
 
-    conjugateResidualSolver(this, &LavaSolver::implicitPressureIntegrationMatrix,
-                            next_quantity, quantity, 300);
+    {
+        ProfilerScope solve(profiler, "pressure_solve");
+        auto iterations = conjugateResidualSolver(this, &LavaSolver::implicitPressureIntegrationMatrix,
+                                                  next_quantity, quantity, 300);
+        solve.setArgument("iterations", iterations);
+    }
 
-    double cellNodeValues[2] = {0, 0};
-    for (auto i = 0; i < numGridFaceXNodes; i++) {
-        auto &faceNode = gridFaceXNodes[i];
+    // Only the min-side faces of interior cells require pressure correction
+    for (auto c : interiorGridCellNodes) {
+        auto const &location = gridCellNodes[c].location;
 
-        // Skip faces that don't require pressure correction
-        if (faceNode.location.x == size.x ||
-            gridCellNode(faceNode.location.x, faceNode.location.y, faceNode.location.z).type != INTERIOR)
-            continue;
+        {
+            auto f = getGridFaceXNodeIndex(location.x, location.y, location.z);
 
-        // x-min boundary
-        if (faceNode.location.x == 0) {
-            cellNodeValues[0] = 0;
-        } else {
-            cellNodeValues[0] = next_quantity[getGridCellNodeIndex(faceNode.location.x - 1, faceNode.location.y,
-                                                                   faceNode.location.z)];
-        }
+            // x-min boundary
+            double cellNodeValue0 = 0;
+            if (location.x > 0) {
+                cellNodeValue0 = next_quantity[getGridCellNodeIndex(location.x - 1, location.y, location.z)];
+            }
 
-        // x-max boundary
-        if (faceNode.location.x == size.x) {
-            cellNodeValues[1] = 0;
-        } else {
-            cellNodeValues[1] = next_quantity[getGridCellNodeIndex(faceNode.location.x, faceNode.location.y,
-                                                                   faceNode.location.z)];
+            gridFaceXNodes.velocity_star[f] -=
+                    delta_t * (next_quantity[c] - cellNodeValue0) * gridFaceXNodes.inv_density[f];
         }
+        {
+            auto f = getGridFaceYNodeIndex(location.x, location.y, location.z);
 
-        faceNode.velocity_star.x -= delta_t * (cellNodeValues[1] - cellNodeValues[0]) * faceNode.inv_density;
-    }
-    for (auto i = 0; i < numGridFaceYNodes; i++) {
-        auto &faceNode = gridFaceYNodes[i];
-
-        // Skip faces that don't require pressure correction
-        if (faceNode.location.y == size.y ||
-            gridCellNode(faceNode.location.x, faceNode.location.y, faceNode.location.z).type != INTERIOR)
-            continue;
-
-        // y-min boundary
-        if (faceNode.location.y == 0) {
-            cellNodeValues[0] = 0;
-        } else {
-            cellNodeValues[0] = next_quantity[getGridCellNodeIndex(faceNode.location.x, faceNode.location.y - 1,
-                                                                   faceNode.location.z)];
-        }
+            // y-min boundary
+            double cellNodeValue0 = 0;
+            if (location.y > 0) {
+                cellNodeValue0 = next_quantity[getGridCellNodeIndex(location.x, location.y - 1, location.z)];
+            }
 
-        // y-max boundary
-        if (faceNode.location.y == size.y) {
-            cellNodeValues[1] = 0;
-        } else {
-            cellNodeValues[1] = next_quantity[getGridCellNodeIndex(faceNode.location.x, faceNode.location.y,
-                                                                   faceNode.location.z)];
+            gridFaceYNodes.velocity_star[f] -=
+                    delta_t * (next_quantity[c] - cellNodeValue0) * gridFaceYNodes.inv_density[f];
         }
+        {
+            auto f = getGridFaceZNodeIndex(location.x, location.y, location.z);
 
-        faceNode.velocity_star.y -= delta_t * (cellNodeValues[1] - cellNodeValues[0]) * faceNode.inv_density;
-    }
-    for (auto i = 0; i < numGridFaceZNodes; i++) {
-        auto &faceNode = gridFaceZNodes[i];
-
-        // Skip faces that don't require pressure correction
-        if (faceNode.location.z == size.z ||
-            gridCellNode(faceNode.location.x, faceNode.location.y, faceNode.location.z).type != INTERIOR)
-            continue;
-
-        // z-min boundary
-        if (faceNode.location.z == 0) {
-            cellNodeValues[0] = 0;
-        } else {
-            cellNodeValues[0] = next_quantity[getGridCellNodeIndex(faceNode.location.x, faceNode.location.y,
-                                                                   faceNode.location.z - 1)];
-        }
+            // z-min boundary
+            double cellNodeValue0 = 0;
+            if (location.z > 0) {
+                cellNodeValue0 = next_quantity[getGridCellNodeIndex(location.x, location.y, location.z - 1)];
+            }
 
-        // z-max boundary
-        if (faceNode.location.z == size.z) {
-            cellNodeValues[1] = 0;
-        } else {
-            cellNodeValues[1] = next_quantity[getGridCellNodeIndex(faceNode.location.x, faceNode.location.y,
-                                                                   faceNode.location.z)];
+            gridFaceZNodes.velocity_star[f] -=
+                    delta_t * (next_quantity[c] - cellNodeValue0) * gridFaceZNodes.inv_density[f];
         }
-
-        faceNode.velocity_star.z -= delta_t * (cellNodeValues[1] - cellNodeValues[0]) * faceNode.inv_density;
     }
 
     // 8. Solve heat equation //////////////////////////////////////////////////////////////////////////////////////////
 
+    phase.next("heat");
+
     for (auto c = 0; c < numGridCellNodes; c++) {
         auto &cellNode = gridCellNodes[c];
 
@@ -730,8 +697,7 @@ void LavaSolver::update() {
 
     }
 
-    conjugateResidualSolver(this, &LavaSolver::implicitHeatIntegrationMatrix,
-                            next_quantity, quantity, 50);
+    integrateHeat(next_quantity, quantity);
 
     for (auto c = 0; c < numGridCellNodes; c++) {
         auto &cellNode = gridCellNodes[c];
@@ -742,290 +708,548 @@ void LavaSolver::update() {
 
     // 9. Update particle state from grid //////////////////////////////////////////////////////////////////////////////
 
-    // Velocity
+    phase.next("g2p");
 
-    for (auto p = 0; p < numParticleNodes; p++) {
-        auto &particleNode = particleNodes[p];
-        auto gcmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1));
-        auto gfxmin = glm::ivec3((particleNode.position / h) - glm::dvec3(0.5, 1, 1));
-        auto gfymin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 0.5, 1));
-        auto gfzmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 1, 0.5));
+    // Velocity, deformation gradient, temperature and phase change are updated in a single pass over blocks of
+    // particles. Velocity and temperature are gathered with the weights memoized at the position the grid was
+    // rasterized with, the velocity gradient at the advected position
 
-        auto v_pic = glm::dvec3();
-        auto v_flip = particleNode.velocity;
+    temperatureBatch.resize(numParticleNodes);
 
-        // Nearby weighted grid face nodes
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfxmin.x + i / 16;
-            auto gy = gfxmin.y + (i / 4) % 4;
-            auto gz = gfxmin.z + i % 4;
-            if (!isValidGridFaceXNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceXNode(gx, gy, gz);
+    // Small enough for the staged temperatures of a block to still be in cache for the phase change kernel
+    size_t const particleBlockSize = 256;
 
-            auto w = particleNode.face_x_weight[i];
-            auto gv = faceNode.velocity.x;
-            auto gv1 = faceNode.velocity_star.x;
+#pragma omp parallel for
+    for (size_t block = 0; block < numParticleNodes; block += particleBlockSize) {
+        auto blockEnd = std::min(block + particleBlockSize, numParticleNodes);
 
-            v_pic.x += gv1 * w;
-            v_flip.x += (gv1 - gv) * w;
+        for (auto p = block; p < blockEnd; p++) {
+            auto &particleNode = particleNodes[p];
+            auto gcmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1));
+            auto gfxmin = glm::ivec3((particleNode.position / h) - glm::dvec3(0.5, 1, 1));
+            auto gfymin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 0.5, 1));
+            auto gfzmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 1, 0.5));
 
-        }
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfymin.x + i / 16;
-            auto gy = gfymin.y + (i / 4) % 4;
-            auto gz = gfymin.z + i % 4;
-            if (!isValidGridFaceYNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceYNode(gx, gy, gz);
+            // Face node indices of the stencils (-1 outside the grid), reused by the velocity gradient
+            int faceXIndices[64];
+            int faceYIndices[64];
+            int faceZIndices[64];
 
-            auto w = particleNode.face_y_weight[i];
-            auto gv = faceNode.velocity.y;
-            auto gv1 = faceNode.velocity_star.y;
+            auto v_pic = glm::dvec3();
+            auto v_flip = particleNode.velocity;
 
-            v_pic.y += gv1 * w;
-            v_flip.y += (gv1 - gv) * w;
+            // Nearby weighted grid face nodes
+            for (unsigned int i = 0; i < 64; i++) {
+                auto gx = gfxmin.x + i / 16;
+                auto gy = gfxmin.y + (i / 4) % 4;
+                auto gz = gfxmin.z + i % 4;
+                faceXIndices[i] = isValidGridFaceXNode(gx, gy, gz) ? (int) getGridFaceXNodeIndex(gx, gy, gz) : -1;
+                if (faceXIndices[i] < 0) continue;
+                auto f = faceXIndices[i];
 
-        }
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfzmin.x + i / 16;
-            auto gy = gfzmin.y + (i / 4) % 4;
-            auto gz = gfzmin.z + i % 4;
-            if (!isValidGridFaceZNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceZNode(gx, gy, gz);
+                auto w = particleNode.face_x_weight[i];
+                auto gv = gridFaceXNodes.velocity[f];
+                auto gv1 = gridFaceXNodes.velocity_star[f];
 
-            auto w = particleNode.face_z_weight[i];
-            auto gv = faceNode.velocity.z;
-            auto gv1 = faceNode.velocity_star.z;
+                v_pic.x += gv1 * w;
+                v_flip.x += (gv1 - gv) * w;
 
-            v_pic.z += gv1 * w;
-            v_flip.z += (gv1 - gv) * w;
+            }
+            for (unsigned int i = 0; i < 64; i++) {
+                auto gx = gfymin.x + i / 16;
+                auto gy = gfymin.y + (i / 4) % 4;
+                auto gz = gfymin.z + i % 4;
+                faceYIndices[i] = isValidGridFaceYNode(gx, gy, gz) ? (int) getGridFaceYNodeIndex(gx, gy, gz) : -1;
+                if (faceYIndices[i] < 0) continue;
+                auto f = faceYIndices[i];
 
-        }
+                auto w = particleNode.face_y_weight[i];
+                auto gv = gridFaceYNodes.velocity[f];
+                auto gv1 = gridFaceYNodes.velocity_star[f];
 
-        particleNode.velocity_star = (1 - alpha) * v_pic + alpha * v_flip;
+                v_pic.y += gv1 * w;
+                v_flip.y += (gv1 - gv) * w;
 
-        // 10
+            }
+            for (unsigned int i = 0; i < 64; i++) {
+                auto gx = gfzmin.x + i / 16;
+                auto gy = gfzmin.y + (i / 4) % 4;
+                auto gz = gfzmin.z + i % 4;
+                faceZIndices[i] = isValidGridFaceZNode(gx, gy, gz) ? (int) getGridFaceZNodeIndex(gx, gy, gz) : -1;
+                if (faceZIndices[i] < 0) continue;
+                auto f = faceZIndices[i];
 
-        if (handleNodeCollisionVelocityUpdate)
-            handleNodeCollisionVelocityUpdate(particleNode);
+                auto w = particleNode.face_z_weight[i];
+                auto gv = gridFaceZNodes.velocity[f];
+                auto gv1 = gridFaceZNodes.velocity_star[f];
 
-        particleNode.velocity = particleNode.velocity_star;
+                v_pic.z += gv1 * w;
+                v_flip.z += (gv1 - gv) * w;
 
-        particleNode.position += delta_t * particleNode.velocity;
+            }
 
-    }
+            auto temperature_pic = 0.0;
+            auto temperature_flip = particleNode.temperature;
 
-    // Deformation gradient
+            // Nearby weighted grid cell nodes
+            for (unsigned int i = 0; i < 64; i++) {
+                auto gx = gcmin.x + i / 16;
+                auto gy = gcmin.y + (i / 4) % 4;
+                auto gz = gcmin.z + i % 4;
+                if (!isValidGridCellNode(gx, gy, gz)) continue;
+                auto &cellNode = gridCellNode(gx, gy, gz);
 
-    for (auto p = 0; p < numParticleNodes; p++) {
-        auto &particleNode = particleNodes[p];
-        auto gcmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1));
-        auto gfxmin = glm::ivec3((particleNode.position / h) - glm::dvec3(0.5, 1, 1));
-        auto gfymin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 0.5, 1));
-        auto gfzmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 1, 0.5));
+                auto w = particleNode.cell_weight[i];
+                auto gt = cellNode.temperature;
+                auto gt1 = cellNode.temperature_next;
 
-        glm::dmat3 nabla_v{};
+                temperature_pic += gt1 * w;
+                temperature_flip += (gt1 - gt) * w;
 
-        // Nearby weighted grid face nodes
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfxmin.x + i / 16;
-            auto gy = gfxmin.y + (i / 4) % 4;
-            auto gz = gfxmin.z + i % 4;
-            if (!isValidGridFaceXNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceXNode(gx, gy, gz);
+            }
 
-            nabla_v += glm::outerProduct(glm::dvec3(faceNode.velocity_star.x, 0, 0),
-                                         tight_nabla_weight(faceNode, particleNode));
+            // Velocity
 
-        }
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfymin.x + i / 16;
-            auto gy = gfymin.y + (i / 4) % 4;
-            auto gz = gfymin.z + i % 4;
-            if (!isValidGridFaceYNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceYNode(gx, gy, gz);
+            particleNode.velocity_star = (1 - alpha) * v_pic + alpha * v_flip;
 
-            nabla_v += glm::outerProduct(glm::dvec3(0, faceNode.velocity_star.y, 0),
-                                         tight_nabla_weight(faceNode, particleNode));
+            // 10
 
-        }
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gfzmin.x + i / 16;
-            auto gy = gfzmin.y + (i / 4) % 4;
-            auto gz = gfzmin.z + i % 4;
-            if (!isValidGridFaceZNode(gx, gy, gz)) continue;
-            auto &faceNode = this->gridFaceZNode(gx, gy, gz);
+            if (handleNodeCollisionVelocityUpdate)
+                handleNodeCollisionVelocityUpdate(particleNode);
+
+            particleNode.velocity = particleNode.velocity_star;
+
+            particleNode.position += delta_t * particleNode.velocity;
+
+            // Deformation gradient
+
+            // Most particles stay within their stencils as they are advected, only those that cross a face look up
+            // their neighbourhoods again
+            auto gfxmin_next = glm::ivec3((particleNode.position / h) - glm::dvec3(0.5, 1, 1));
+            auto gfymin_next = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 0.5, 1));
+            auto gfzmin_next = glm::ivec3((particleNode.position / h) - glm::dvec3(1, 1, 0.5));
+            if (gfxmin_next != gfxmin) {
+                gfxmin = gfxmin_next;
+                for (unsigned int i = 0; i < 64; i++) {
+                    auto gx = gfxmin.x + i / 16;
+                    auto gy = gfxmin.y + (i / 4) % 4;
+                    auto gz = gfxmin.z + i % 4;
+                    faceXIndices[i] = isValidGridFaceXNode(gx, gy, gz) ? (int) getGridFaceXNodeIndex(gx, gy, gz) : -1;
+                }
+            }
+            if (gfymin_next != gfymin) {
+                gfymin = gfymin_next;
+                for (unsigned int i = 0; i < 64; i++) {
+                    auto gx = gfymin.x + i / 16;
+                    auto gy = gfymin.y + (i / 4) % 4;
+                    auto gz = gfymin.z + i % 4;
+                    faceYIndices[i] = isValidGridFaceYNode(gx, gy, gz) ? (int) getGridFaceYNodeIndex(gx, gy, gz) : -1;
+                }
+            }
+            if (gfzmin_next != gfzmin) {
+                gfzmin = gfzmin_next;
+                for (unsigned int i = 0; i < 64; i++) {
+                    auto gx = gfzmin.x + i / 16;
+                    auto gy = gfzmin.y + (i / 4) % 4;
+                    auto gz = gfzmin.z + i % 4;
+                    faceZIndices[i] = isValidGridFaceZNode(gx, gy, gz) ? (int) getGridFaceZNodeIndex(gx, gy, gz) : -1;
+                }
+            }
+
+            glm::dvec3 face_tight_nabla_weight[64];
+
+            glm::dmat3 nabla_v{};
+
+            // Nearby weighted grid face nodes
+            tight_nabla_n((glm::dvec3(gfxmin) - glm::dvec3(0.5, 0, 0)) * h, particleNode.position,
+                          face_tight_nabla_weight);
+            for (unsigned int i = 0; i < 64; i++) {
+                if (faceXIndices[i] < 0) continue;
+                auto gv1 = gridFaceXNodes.velocity_star[faceXIndices[i]];
+
+                nabla_v += glm::outerProduct(glm::dvec3(gv1, 0, 0), face_tight_nabla_weight[i]);
 
-            nabla_v += glm::outerProduct(glm::dvec3(0, 0, faceNode.velocity_star.z),
-                                         tight_nabla_weight(faceNode, particleNode));
+            }
+            tight_nabla_n((glm::dvec3(gfymin) - glm::dvec3(0, 0.5, 0)) * h, particleNode.position,
+                          face_tight_nabla_weight);
+            for (unsigned int i = 0; i < 64; i++) {
+                if (faceYIndices[i] < 0) continue;
+                auto gv1 = gridFaceYNodes.velocity_star[faceYIndices[i]];
+
+                nabla_v += glm::outerProduct(glm::dvec3(0, gv1, 0), face_tight_nabla_weight[i]);
+
+            }
+            tight_nabla_n((glm::dvec3(gfzmin) - glm::dvec3(0, 0, 0.5)) * h, particleNode.position,
+                          face_tight_nabla_weight);
+            for (unsigned int i = 0; i < 64; i++) {
+                if (faceZIndices[i] < 0) continue;
+                auto gv1 = gridFaceZNodes.velocity_star[faceZIndices[i]];
+
+                nabla_v += glm::outerProduct(glm::dvec3(0, 0, gv1), face_tight_nabla_weight[i]);
+
+            }
+
+            auto multiplier = deformationUpdateR(delta_t * nabla_v);
+
+            glm::dmat3 deform = particleNode.deformElastic * particleNode.deformPlastic;
+            glm::dmat3 deform_prime = multiplier * deform;
+            auto deformElastic_prime = multiplier * particleNode.deformElastic;
+
+            // Remove deviatoric component if liquid
+            if (particleNode.temperature > particleNode.fusionTemperature + FLT_EPSILON) {
+                deformElastic_prime = glm::dmat3(pow(glm::determinant(deformElastic_prime), 1.0 / 3.0));
+            }
+
+            glm::dmat3 u;
+            glm::dvec3 e;
+            glm::dmat3 v;
+            svd(deformElastic_prime, u, e, v);
+            e = glm::clamp(e, 1 - particleNode.criticalCompression, 1 + particleNode.criticalStretch);
+
+            particleNode.deformElastic = u * glm::dmat3(e.x, 0, 0, 0, e.y, 0, 0, 0, e.z) * glm::transpose(v);
+            particleNode.deformPlastic =
+                    v * glm::dmat3(1 / e.x, 0, 0, 0, 1 / e.y, 0, 0, 0, 1 / e.z) * glm::transpose(u) * deform_prime;
+
+            auto jp = glm::determinant(particleNode.deformPlastic);
+            particleNode.deformElastic = pow(jp, 1.0 / 3.0) * particleNode.deformElastic;
+            particleNode.deformPlastic = pow(jp, -1.0 / 3.0) * particleNode.deformPlastic;
+
+            // Temperature (staged for the phase change kernel)
+
+            auto temperature_next = (1 - alpha) * temperature_pic + alpha * temperature_flip;
+
+            temperatureBatch.temperature[p] = particleNode.temperature;
+            temperatureBatch.latentHeat[p] = particleNode.latentHeat;
+            temperatureBatch.temperatureDifference[p] = temperature_next - particleNode.temperature;
+            temperatureBatch.mass[p] = particleNode.mass;
+            temperatureBatch.specificHeat[p] = particleNode.specificHeat;
+            temperatureBatch.fusionTemperature[p] = particleNode.fusionTemperature;
+            temperatureBatch.latentHeatOfFusion[p] = particleNode.latentHeatOfFusion;
 
         }
 
-        auto multiplier = deformationUpdateR(delta_t * nabla_v);
+        // Phase change of the block, once its deformation gradients have read the temperatures of this tick
 
-        glm::dmat3 deform = particleNode.deformElastic * particleNode.deformPlastic;
-        glm::dmat3 deform_prime = multiplier * deform;
-        auto deformElastic_prime = multiplier * particleNode.deformElastic;
+        applyTemperatureDifferences(temperatureBatch, block, blockEnd);
+
+        for (auto p = block; p < blockEnd; p++) {
+            auto &particleNode = particleNodes[p];
+
+            particleNode.temperature = temperatureBatch.temperature[p];
+            particleNode.latentHeat = temperatureBatch.latentHeat[p];
 
-        // Remove deviatoric component if liquid
-        if (particleNode.temperature > particleNode.fusionTemperature + FLT_EPSILON) {
-            deformElastic_prime = glm::dmat3(pow(glm::determinant(deformElastic_prime), 1.0 / 3.0));
         }
 
-        glm::dmat3 u;
-        glm::dvec3 e;
-        glm::dmat3 v;
-        svd(deformElastic_prime, u, e, v);
-        e = glm::clamp(e, 1 - particleNode.criticalCompression, 1 + particleNode.criticalStretch);
+    }
+
+    tick++;
+    time += delta_t;
+}
+
+double LavaSolver::cflTimeStep() {
+    auto numParticleNodes = particleNodes.size();
+
+    // Face velocities are mass weighted averages of particle velocities, so they are never faster
+    double maxSpeed = 0;
 
-        particleNode.deformElastic = u * glm::dmat3(e.x, 0, 0, 0, e.y, 0, 0, 0, e.z) * glm::transpose(v);
-        particleNode.deformPlastic =
-                v * glm::dmat3(1 / e.x, 0, 0, 0, 1 / e.y, 0, 0, 0, 1 / e.z) * glm::transpose(u) * deform_prime;
+#pragma omp parallel for reduction(max:maxSpeed)
+    for (auto p = 0; p < numParticleNodes; p++) {
+        auto const &particleNode = particleNodes[p];
+        auto speed = glm::length(particleNode.velocity);
 
+        // Volumes are computed on the first tick, before which particles are undeformed and carry no waves
         auto jp = glm::determinant(particleNode.deformPlastic);
-        particleNode.deformElastic = pow(jp, 1.0 / 3.0) * particleNode.deformElastic;
-        particleNode.deformPlastic = pow(jp, -1.0 / 3.0) * particleNode.deformPlastic;
+        auto je = glm::determinant(particleNode.deformElastic);
+        if (particleNode.volume0 > 0 && particleNode.mass > 0 && je * jp > 0) {
+            auto e = exp(particleNode.hardeningCoefficient * (1 - jp));
+            auto mu = particleNode.temperature > particleNode.fusionTemperature + FLT_EPSILON ? 0 : particleNode.mu0;
+
+            // P-wave modulus over the current density
+            speed += sqrt((particleNode.lambda0 + 2 * mu) * e * particleNode.volume0 * je * jp / particleNode.mass);
+        }
 
+        maxSpeed = std::max(maxSpeed, speed);
     }
 
-    // Temperature
+    return maxSpeed > 0 ? cfl * h / maxSpeed : std::numeric_limits<double>::infinity();
+}
 
-    for (auto p = 0; p < numParticleNodes; p++) {
-        auto &particleNode = particleNodes[p];
-        auto gmin = glm::ivec3((particleNode.position / h) - glm::dvec3(1));
+void LavaSolver::chooseTimeStep(double endTime) {
+    if (maxDelta_t <= 0) maxDelta_t = delta_t;
+    delta_t = chooseSolverTimeStep(time, endTime, cfl, maxDelta_t, [this] { return cflTimeStep(); });
+}
 
-        auto temperature_pic = 0.0;
-        auto temperature_flip = particleNode.temperature;
+std::vector<SolverMemoryUsage> LavaSolver::memoryUsage() const {
+    auto numGridCellNodes = static_cast<size_t>(size.x) * size.y * size.z;
+    auto numParticleNodes = particleNodes.size();
 
-        // Nearby weighted grid nodes
-        for (unsigned int i = 0; i < 64; i++) {
-            auto gx = gmin.x + i / 16;
-            auto gy = gmin.y + (i / 4) % 4;
-            auto gz = gmin.z + i % 4;
-            if (!isValidGridCellNode(gx, gy, gz)) continue;
-            auto &cellNode = gridCellNode(gx, gy, gz);
+    auto cellLists = (dirtyGridCellNodes.capacity() + collidingGridCellNodes.capacity() +
+                      interiorGridCellNodes.capacity()) * sizeof(unsigned int);
+
+    // Seven arrays of particle temperatures and materials
+    auto temperatures = 7 * std::max(numParticleNodes, temperatureBatch.temperature.capacity()) * sizeof(double);
+
+    // The pressures or temperatures of the linear solves, five vectors of the residual solver and two temporaries of
+    // its vector arithmetic, the pressure and heat solves take turns
+    auto linearSolve = 9 * numGridCellNodes * sizeof(double);
+
+    return {
+            {"particles",         particleNodes.capacity() * sizeof(LavaParticleNode)},
+            {"grid_cells",        std::max(numGridCellNodes, gridCellNodes.capacity()) * sizeof(LavaGridCellNode)},
+            {"grid_faces_x",      gridFaceXNodes.memoryUsage((size.x + 1) * size.y * size.z)},
+            {"grid_faces_y",      gridFaceYNodes.memoryUsage(size.x * (size.y + 1) * size.z)},
+            {"grid_faces_z",      gridFaceZNodes.memoryUsage(size.x * size.y * (size.z + 1))},
+            {"cell_lists",        cellLists},
+            {"temperature_batch", temperatures},
+            {"linear_solve",      linearSolve},
+    };
+}
 
-            auto w = particleNode.cell_weight[i];
-            auto gt = cellNode.temperature;
-            auto gt1 = cellNode.temperature_next;
+void LavaSolver::applyTemperatureDifferences(TemperatureBatch &batch) {
+    auto count = batch.temperature.size();
+    size_t const blockSize = 256;
 
-            temperature_pic += gt1 * w;
-            temperature_flip += (gt1 - gt) * w;
+#pragma omp parallel for
+    for (size_t begin = 0; begin < count; begin += blockSize) {
+        applyTemperatureDifferences(batch, begin, std::min(begin + blockSize, count));
+    }
+}
 
-        }
+void LavaSolver::applyTemperatureDifferences(TemperatureBatch &batch, size_t begin, size_t end) {
+
+    auto temperature = batch.temperature.data();
+    auto latentHeat = batch.latentHeat.data();
+    auto temperatureDifference = batch.temperatureDifference.data();
+    auto mass = batch.mass.data();
+    auto specificHeat = batch.specificHeat.data();
+    auto fusionTemperature = batch.fusionTemperature.data();
+    auto latentHeatOfFusion = batch.latentHeatOfFusion.data();
+
+#pragma omp simd
+    for (size_t p = begin; p < end; p++) {
+        auto t = temperature[p];
+        auto l = latentHeat[p];
+        auto m = mass[p];
+        auto c = specificHeat[p];
+        auto tf = fusionTemperature[p];
+
+        // Latent heat of fusion for phase change
+        double latentEnergyOfFusion = m * latentHeatOfFusion[p]; // [J]
+
+        auto newTemperature = t + temperatureDifference[p];
+
+        // Fluid: remain as fluid, freeze through or stop at the freezing point
+        auto freezingJoules = c * m * (tf - newTemperature);
+        auto remainFluid = newTemperature - FLT_EPSILON > tf;
+        auto freezeThrough = freezingJoules >= latentEnergyOfFusion;
+        auto fluidTemperature = remainFluid ? newTemperature :
+                                freezeThrough ? newTemperature + latentEnergyOfFusion / m / c : tf;
+        auto fluidLatentHeat = remainFluid || freezeThrough ? l : latentEnergyOfFusion - freezingJoules;
+
+        // Solid: remain as solid, melt through or stop at the melting point
+        auto meltingJoules = c * m * (newTemperature - tf);
+        auto remainSolid = newTemperature + FLT_EPSILON < tf;
+        auto meltThrough = meltingJoules >= latentEnergyOfFusion;
+        auto solidTemperature = remainSolid ? newTemperature :
+                                meltThrough ? newTemperature - latentEnergyOfFusion / m / c : tf;
+        auto solidLatentHeat = remainSolid || meltThrough ? l : meltingJoules;
+
+        // Melting/freezing: melted, frozen or still in phase-change state
+        auto newLatentEnergy = l + c * m * temperatureDifference[p];
+        auto melted = newLatentEnergy > latentEnergyOfFusion;
+        auto frozen = newLatentEnergy < 0;
+        auto phaseChangeTemperature = melted ? t + (newLatentEnergy - latentEnergyOfFusion) / m / c :
+                                      frozen ? t + newLatentEnergy / m / c : t;
+        auto phaseChangeLatentHeat = melted || frozen ? l : newLatentEnergy;
+
+        auto fluid = t - FLT_EPSILON > tf;
+        auto solid = t + FLT_EPSILON < tf;
+        temperature[p] = fluid ? fluidTemperature : solid ? solidTemperature : phaseChangeTemperature;
+        latentHeat[p] = fluid ? fluidLatentHeat : solid ? solidLatentHeat : phaseChangeLatentHeat;
+    }
+}
 
-        auto temperature_next = (1 - alpha) * temperature_pic + alpha * temperature_flip;
+double LavaSolver::heatDiffusion(std::vector<double> const &x, size_t c) {
+    auto const &cellNode = gridCellNodes[c];
+    auto const &location = cellNode.location;
 
-        applyTemperatureDifference(particleNode, temperature_next - particleNode.temperature);
+    double faceNodeValues[6] = {0, 0, 0, 0, 0, 0};
 
+    // x-min boundary
+    if (location.x > 0) {
+        faceNodeValues[0] = x[c] - x[getGridCellNodeIndex(location.x - 1, location.y, location.z)];
     }
 
-    tick++;
+    // x-max boundary
+    if (location.x < size.x - 1) {
+        faceNodeValues[1] = x[getGridCellNodeIndex(location.x + 1, location.y, location.z)] - x[c];
+    }
+
+    // y-min boundary
+    if (location.y > 0) {
+        faceNodeValues[2] = x[c] - x[getGridCellNodeIndex(location.x, location.y - 1, location.z)];
+    }
+
+    // y-max boundary
+    if (location.y < size.y - 1) {
+        faceNodeValues[3] = x[getGridCellNodeIndex(location.x, location.y + 1, location.z)] - x[c];
+    }
+
+    // z-min boundary
+    if (location.z > 0) {
+        faceNodeValues[4] = x[c] - x[getGridCellNodeIndex(location.x, location.y, location.z - 1)];
+    }
+
+    // z-max boundary
+    if (location.z < size.z - 1) {
+        faceNodeValues[5] = x[getGridCellNodeIndex(location.x, location.y, location.z + 1)] - x[c];
+    }
+
+    auto fx0 = getGridFaceXNodeIndex(location.x, location.y, location.z);
+    auto fx1 = getGridFaceXNodeIndex(location.x + 1, location.y, location.z);
+    auto fy0 = getGridFaceYNodeIndex(location.x, location.y, location.z);
+    auto fy1 = getGridFaceYNodeIndex(location.x, location.y + 1, location.z);
+    auto fz0 = getGridFaceZNodeIndex(location.x, location.y, location.z);
+    auto fz1 = getGridFaceZNodeIndex(location.x, location.y, location.z + 1);
+
+    return pow(h, 3) / (cellNode.mass * cellNode.specificHeat) *
+           (gridFaceXNodes.thermalConductivity[fx1] * faceNodeValues[1] -
+            gridFaceXNodes.thermalConductivity[fx0] * faceNodeValues[0] +
+            gridFaceYNodes.thermalConductivity[fy1] * faceNodeValues[3] -
+            gridFaceYNodes.thermalConductivity[fy0] * faceNodeValues[2] +
+            gridFaceZNodes.thermalConductivity[fz1] * faceNodeValues[5] -
+            gridFaceZNodes.thermalConductivity[fz0] * faceNodeValues[4]);
 }
 
-void LavaSolver::implicitHeatIntegrationMatrix(std::vector<double> &Ax,
-                                               std::vector<double> const &x) {
+void LavaSolver::integrateHeat(std::vector<double> &next_x, std::vector<double> &x) {
 
-    auto numGridCellNodes = gridCellNodes.size();
+    auto implicitIterations = 50;
+    auto maxExplicitSubsteps = 1000u;
 
-    for (auto c = 0; c < numGridCellNodes; c++) {
-        auto const &cellNode = gridCellNodes[c];
+    auto useExplicit = false;
+    auto explicitSubsteps = 0u;
 
-        // Continue if later calculation may cause divide-by-zero error
-        if (cellNode.mass == 0 || cellNode.specificHeat == 0) continue;
+    if (heatIntegration != IMPLICIT_HEAT_INTEGRATION) {
 
-        double faceNodeValues[6] = {0, 0, 0, 0, 0, 0};
+        // Explicit substeps needed to stay below the stability limit of every cell
+        auto timeStepLimit = explicitHeatIntegrationTimeStepLimit();
+        explicitSubsteps = delta_t / timeStepLimit < maxExplicitSubsteps ?
+                           std::max(1u, (unsigned int) ceil(delta_t / timeStepLimit)) :
+                           maxExplicitSubsteps + 1;
 
-        // x-min boundary
-        if (cellNode.location.x == 0) {
-            faceNodeValues[0] = 0;
-        } else {
-            faceNodeValues[0] = x[c] - x[getGridCellNodeIndex(cellNode.location.x - 1,
-                                                              cellNode.location.y,
-                                                              cellNode.location.z)];
-        }
+        // Each residual iteration costs about two stencil sweeps, on top of the three it starts with
+        useExplicit =
+                (heatIntegration == EXPLICIT_HEAT_INTEGRATION && explicitSubsteps <= maxExplicitSubsteps) ||
+                (heatIntegration == AUTO_HEAT_INTEGRATION && explicitSubsteps <= 3 + 2 * implicitIterations);
 
-        // x-max boundary
-        if (cellNode.location.x == size.x - 1) {
-            faceNodeValues[1] = 0;
-        } else {
-            faceNodeValues[1] = x[getGridCellNodeIndex(cellNode.location.x + 1,
-                                                       cellNode.location.y,
-                                                       cellNode.location.z)] - x[c];
+        if (heatIntegration == EXPLICIT_HEAT_INTEGRATION && !useExplicit && !explicitHeatIntegrationFellBack) {
+            LOG(INFO) << "Explicit heat integration needs more than " << maxExplicitSubsteps
+                      << " substeps, falling back to implicit" << std::endl;
+            explicitHeatIntegrationFellBack = true;
         }
+    }
 
-        // y-min boundary
-        if (cellNode.location.y == 0) {
-            faceNodeValues[2] = 0;
-        } else {
-            faceNodeValues[2] = x[c] - x[getGridCellNodeIndex(cellNode.location.x,
-                                                              cellNode.location.y - 1,
-                                                              cellNode.location.z)];
-        }
+    if (useExplicit) {
+        ProfilerScope solve(profiler, "heat_substeps");
+        solve.setArgument("substeps", explicitSubsteps);
 
-        // y-max boundary
-        if (cellNode.location.y == size.y - 1) {
-            faceNodeValues[3] = 0;
-        } else {
-            faceNodeValues[3] = x[getGridCellNodeIndex(cellNode.location.x,
-                                                       cellNode.location.y + 1,
-                                                       cellNode.location.z)] - x[c];
+        auto dt = delta_t / explicitSubsteps;
+        for (auto i = 0u; i < explicitSubsteps; i++) {
+            explicitHeatIntegrationStep(next_x, x, dt);
+            std::swap(x, next_x);
         }
+        std::swap(x, next_x);
+    } else {
+        ProfilerScope solve(profiler, "heat_solve");
+        auto iterations = conjugateResidualSolver(this, &LavaSolver::implicitHeatIntegrationMatrix,
+                                                  next_x, x, implicitIterations);
+        solve.setArgument("iterations", iterations);
+    }
+}
 
-        // z-min boundary
-        if (cellNode.location.z == 0) {
-            faceNodeValues[4] = 0;
-        } else {
-            faceNodeValues[4] = x[c] - x[getGridCellNodeIndex(cellNode.location.x,
-                                                              cellNode.location.y,
-                                                              cellNode.location.z - 1)];
-        }
+double LavaSolver::explicitHeatIntegrationTimeStepLimit() {
 
-        // z-max boundary
-        if (cellNode.location.z == size.z - 1) {
-            faceNodeValues[5] = 0;
-        } else {
-            faceNodeValues[5] = x[getGridCellNodeIndex(cellNode.location.x,
-                                                       cellNode.location.y,
-                                                       cellNode.location.z + 1)] - x[c];
-        }
+    auto limit = std::numeric_limits<double>::infinity();
 
-        Ax[c] = x[c] + delta_t * pow(h, 3) / (cellNode.mass * cellNode.specificHeat) *
-                       (gridFaceXNode(cellNode.location.x + 1,
-                                      cellNode.location.y,
-                                      cellNode.location.z).thermalConductivity * faceNodeValues[1] -
-                        gridFaceXNode(cellNode.location.x,
-                                      cellNode.location.y,
-                                      cellNode.location.z).thermalConductivity * faceNodeValues[0] +
-                        gridFaceYNode(cellNode.location.x,
-                                      cellNode.location.y + 1,
-                                      cellNode.location.z).thermalConductivity * faceNodeValues[3] -
-                        gridFaceYNode(cellNode.location.x,
-                                      cellNode.location.y,
-                                      cellNode.location.z).thermalConductivity * faceNodeValues[2] +
-                        gridFaceZNode(cellNode.location.x,
-                                      cellNode.location.y,
-                                      cellNode.location.z + 1).thermalConductivity * faceNodeValues[5] -
-                        gridFaceZNode(cellNode.location.x,
-                                      cellNode.location.y,
-                                      cellNode.location.z).thermalConductivity * faceNodeValues[4]);
+#pragma omp parallel for reduction(min:limit)
+    for (auto c = 0; c < gridCellNodes.size(); c++) {
+        auto const &cellNode = gridCellNodes[c];
 
+        if (cellNode.mass == 0 || cellNode.specificHeat == 0) continue;
+
+        auto const &location = cellNode.location;
+
+        // Sum of the conductivities coupling this cell to its neighbours, faces on the grid boundary are insulated
+        double conductivity = 0;
+        if (location.x > 0) conductivity += gridFaceXNodes.thermalConductivity[
+                    getGridFaceXNodeIndex(location.x, location.y, location.z)];
+        if (location.x < size.x - 1) conductivity += gridFaceXNodes.thermalConductivity[
+                    getGridFaceXNodeIndex(location.x + 1, location.y, location.z)];
+        if (location.y > 0) conductivity += gridFaceYNodes.thermalConductivity[
+                    getGridFaceYNodeIndex(location.x, location.y, location.z)];
+        if (location.y < size.y - 1) conductivity += gridFaceYNodes.thermalConductivity[
+                    getGridFaceYNodeIndex(location.x, location.y + 1, location.z)];
+        if (location.z > 0) conductivity += gridFaceZNodes.thermalConductivity[
+                    getGridFaceZNodeIndex(location.x, location.y, location.z)];
+        if (location.z < size.z - 1) conductivity += gridFaceZNodes.thermalConductivity[
+                    getGridFaceZNodeIndex(location.x, location.y, location.z + 1)];
+
+        if (conductivity == 0) continue;
+
+        // Forward Euler keeps the new temperature a convex combination of its neighbours below this step
+        limit = std::min(limit, cellNode.mass * cellNode.specificHeat / (pow(h, 3) * conductivity));
     }
 
+    return limit;
 }
 
-void LavaSolver::implicitPressureIntegrationMatrix(std::vector<double> &Ax, std::vector<double> const &x) {
+void LavaSolver::explicitHeatIntegrationStep(std::vector<double> &next_x, std::vector<double> const &x,
+                                             double dt) {
 
     auto numGridCellNodes = gridCellNodes.size();
 
+#pragma omp parallel for
     for (auto c = 0; c < numGridCellNodes; c++) {
         auto const &cellNode = gridCellNodes[c];
 
-        // Continue if later calculation may cause divide-by-zero error
-        if (cellNode.type != INTERIOR || cellNode.mass == 0) {
-            Ax[c] = x[c];
+        if (cellNode.mass == 0 || cellNode.specificHeat == 0) {
+            next_x[c] = x[c];
             continue;
         }
 
+        next_x[c] = x[c] + dt * heatDiffusion(x, c);
+    }
+}
+
+void LavaSolver::implicitHeatIntegrationMatrix(std::vector<double> &Ax,
+                                               std::vector<double> const &x) {
+
+    auto numGridCellNodes = gridCellNodes.size();
+
+    for (auto c = 0; c < numGridCellNodes; c++) {
+        auto const &cellNode = gridCellNodes[c];
+
+        // Continue if later calculation may cause divide-by-zero error
+        if (cellNode.mass == 0 || cellNode.specificHeat == 0) continue;
+
+        // Backward Euler: (I - delta_t L) T_next = T
+        Ax[c] = x[c] - delta_t * heatDiffusion(x, c);
+
+    }
+
+}
+
+void LavaSolver::implicitPressureIntegrationMatrix(std::vector<double> &Ax, std::vector<double> const &x) {
+
+    // Identity on all but the interior cells
+    Ax = x;
+
+    for (auto c : interiorGridCellNodes) {
+        auto const &cellNode = gridCellNodes[c];
+
+        // Continue if later calculation may cause divide-by-zero error
+        if (cellNode.mass == 0) continue;
+
         double faceNodeValues[6] = {0, 0, 0, 0, 0, 0};
 
         // x-min boundary
@@ -1082,96 +1306,224 @@ void LavaSolver::implicitPressureIntegrationMatrix(std::vector<double> &Ax, std:
                                                        cellNode.location.z + 1)] - x[c];
         }
 
+        auto const &location = cellNode.location;
+        auto fx0 = getGridFaceXNodeIndex(location.x, location.y, location.z);
+        auto fx1 = getGridFaceXNodeIndex(location.x + 1, location.y, location.z);
+        auto fy0 = getGridFaceYNodeIndex(location.x, location.y, location.z);
+        auto fy1 = getGridFaceYNodeIndex(location.x, location.y + 1, location.z);
+        auto fz0 = getGridFaceZNodeIndex(location.x, location.y, location.z);
+        auto fz1 = getGridFaceZNodeIndex(location.x, location.y, location.z + 1);
+
         Ax[c] = (cellNode.jp * x[c] * cellNode.inv_lambda) / (cellNode.je * delta_t) +
-                delta_t * (gridFaceXNode(cellNode.location.x + 1,
-                                         cellNode.location.y,
-                                         cellNode.location.z).inv_density * faceNodeValues[1] -
-                           gridFaceXNode(cellNode.location.x,
-                                         cellNode.location.y,
-                                         cellNode.location.z).inv_density * faceNodeValues[0] +
-                           gridFaceYNode(cellNode.location.x,
-                                         cellNode.location.y + 1,
-                                         cellNode.location.z).inv_density * faceNodeValues[3] -
-                           gridFaceYNode(cellNode.location.x,
-                                         cellNode.location.y,
-                                         cellNode.location.z).inv_density * faceNodeValues[2] +
-                           gridFaceZNode(cellNode.location.x,
-                                         cellNode.location.y,
-                                         cellNode.location.z + 1).inv_density * faceNodeValues[5] -
-                           gridFaceZNode(cellNode.location.x,
-                                         cellNode.location.y,
-                                         cellNode.location.z).inv_density * faceNodeValues[4]);
+                delta_t * (gridFaceXNodes.inv_density[fx1] * faceNodeValues[1] -
+                           gridFaceXNodes.inv_density[fx0] * faceNodeValues[0] +
+                           gridFaceYNodes.inv_density[fy1] * faceNodeValues[3] -
+                           gridFaceYNodes.inv_density[fy0] * faceNodeValues[2] +
+                           gridFaceZNodes.inv_density[fz1] * faceNodeValues[5] -
+                           gridFaceZNodes.inv_density[fz0] * faceNodeValues[4]);
 
     }
 
 }
 
-void LavaSolver::saveState(std::string const &filename) {
+// Per-particle scalars, stored in single precision
+static struct {
+    char const *name;
+    double LavaParticleNode::*member;
+} const lavaParticleScalarColumns[] = {
+        {"mass", &LavaParticleNode::mass},
+        {"temperature", &LavaParticleNode::temperature},
+        {"criticalCompression", &LavaParticleNode::criticalCompression},
+        {"criticalStretch", &LavaParticleNode::criticalStretch},
+        {"hardeningCoefficient", &LavaParticleNode::hardeningCoefficient},
+        {"youngsModulus0", &LavaParticleNode::youngsModulus0},
+        {"poissonsRatio", &LavaParticleNode::poissonsRatio},
+        {"thermalConductivity", &LavaParticleNode::thermalConductivity},
+        {"specificHeat", &LavaParticleNode::specificHeat},
+        {"fusionTemperature", &LavaParticleNode::fusionTemperature},
+        {"latentHeatOfFusion", &LavaParticleNode::latentHeatOfFusion},
+        {"latentHeat", &LavaParticleNode::latentHeat},
+        {"volume0", &LavaParticleNode::volume0}
+};
+
+std::vector<std::string> const LavaSolver::vizFields = {"position", "temperature", "fusionTemperature"};
+
+size_t LavaSolver::packState(std::vector<char> &buffer, StateFileCompression compression,
+                            StateFileKeyframes *keyframes, std::vector<std::string> const &fields) {
+    StateFileWriter writer(buffer, STATE_FILE_SOLVER_LAVA, particleNodes.size(), compression, keyframes);
+
+    writer.addParameter("h", h);
+    writer.addParameter("sizeX", size.x);
+    writer.addParameter("sizeY", size.y);
+    writer.addParameter("sizeZ", size.z);
+    writer.addParameter("tick", tick);
+    writer.addParameter("time", time);
+    writer.addParameter("delta_t", delta_t);
+    writer.addParameter("cfl", cfl);
+    writer.addParameter("maxDelta_t", maxDelta_t);
+    writer.addParameter("alpha", alpha);
+
+    auto isSelected = [&fields](char const *name) {
+        return fields.empty() || std::find(fields.begin(), fields.end(), name) != fields.end();
+    };
+
+    // Particles stay within the grid
+    auto positionQuantization = h * std::max(size.x, std::max(size.y, size.z)) / 65535;
+
+    if (isSelected("position")) {
+        writer.addColumn<double>("position", 3, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].position), 3, values);
+        }, positionQuantization);
+    }
+    if (isSelected("velocity")) {
+        writer.addColumn<double>("velocity", 3, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].velocity), 3, values);
+        });
+    }
+    for (auto const &column : lavaParticleScalarColumns) {
+        if (!isSelected(column.name)) continue;
+        auto member = column.member;
+        writer.addColumn<float>(column.name, 1, [this, member](size_t p, float *values) {
+            values[0] = static_cast<float>(particleNodes[p].*member);
+        });
+    }
+    if (isSelected("deformElastic")) {
+        writer.addColumn<double>("deformElastic", 9, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].deformElastic), 9, values);
+        });
+    }
+    if (isSelected("deformPlastic")) {
+        writer.addColumn<double>("deformPlastic", 9, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].deformPlastic), 9, values);
+        });
+    }
+
+    return writer.finish();
+}
+
+size_t LavaSolver::saveState(std::string const &filename, StateFileCompression compression) {
+    auto bytes = packState(stateBuffer, compression);
+
     std::ofstream file;
     file.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    file.write(stateBuffer.data(), bytes);
+    file.close();
+
+    return file ? bytes : 0;
+}
+
+bool LavaSolver::loadState(std::string const &filename, std::vector<std::string> const &fields) {
+    StateFileView state(filename);
+    if (!state.isOpen()) {
+        return loadLegacyState(filename);
+    }
+
+    return loadState(state, fields);
+}
+
+bool LavaSolver::loadState(StateFileView const &state, std::vector<std::string> const &fields) {
+    LavaParticleNode emptyParticleNode{{},
+                                       {}};
+
+    if (state.header().solver != STATE_FILE_SOLVER_LAVA) {
+        LOG(ERROR) << "Unexpected file type" << std::endl;
+        return false;
+    }
 
-    LAVA_SOLVER_STATE_HEADER solverStateHeader{
-            'LA',
-            sizeof(LAVA_SOLVER_STATE_HEADER),
-            static_cast<float>(h),
-            size,
-            tick,
-            static_cast<float>(delta_t),
-            static_cast<float>(alpha),
-            particleNodes.size()
+    h = state.parameter("h", h);
+    size = glm::uvec3(state.parameter("sizeX", size.x),
+                      state.parameter("sizeY", size.y),
+                      state.parameter("sizeZ", size.z));
+    tick = static_cast<unsigned int>(state.parameter("tick", tick));
+    delta_t = state.parameter("delta_t", delta_t);
+    time = state.parameter("time", tick * delta_t); // Steps were fixed before it was saved
+    cfl = state.parameter("cfl", cfl);
+    maxDelta_t = state.parameter("maxDelta_t", maxDelta_t);
+    alpha = state.parameter("alpha", alpha);
+    particleNodes.resize(state.numParticles(), emptyParticleNode);
+
+    auto isSelected = [&fields](char const *name) {
+        return fields.empty() || std::find(fields.begin(), fields.end(), name) != fields.end();
     };
 
-    file.write(reinterpret_cast<char *>(&solverStateHeader), sizeof(LAVA_SOLVER_STATE_HEADER));
-
-    LAVA_SOLVER_STATE_PARTICLE particleState{};
-    for (auto const &particleNode : particleNodes) {
-        particleState.position = particleNode.position;
-        particleState.velocity = particleNode.velocity;
-        particleState.mass = particleNode.mass;
-        particleState.temperature = particleNode.temperature;
-        particleState.criticalCompression = particleNode.criticalCompression;
-        particleState.criticalStretch = particleNode.criticalStretch;
-        particleState.hardeningCoefficient = particleNode.hardeningCoefficient;
-        particleState.youngsModulus0 = particleNode.youngsModulus0;
-        particleState.poissonsRatio = particleNode.poissonsRatio;
-        particleState.thermalConductivity = particleNode.thermalConductivity;
-        particleState.specificHeat = particleNode.specificHeat;
-        particleState.fusionTemperature = particleNode.fusionTemperature;
-        particleState.latentHeatOfFusion = particleNode.latentHeatOfFusion;
-        particleState.latentHeat = particleNode.latentHeat;
-        particleState.volume0 = particleNode.volume0;
-        particleState.deformElastic = particleNode.deformElastic;
-        particleState.deformPlastic = particleNode.deformPlastic;
-
-        file.write(reinterpret_cast<char *>(&particleState), sizeof(LAVA_SOLVER_STATE_PARTICLE));
+    // Columns that were not asked for may be absent, e.g. all but the viz fields of viz frames, any other column that
+    // cannot be read fails the load
+    auto isAbsent = [&state, &fields](char const *name) {
+        if (fields.empty() && !state.column(name)) return true;
+        LOG(ERROR) << "Unable to read column " << name << std::endl;
+        return false;
+    };
+    auto loaded = true;
+
+    if (isSelected("position")) {
+        loaded &= state.readColumn<double>("position", 3, [this](size_t p, double const *values) {
+            particleNodes[p].position = glm::make_vec3(values);
+        }) || isAbsent("position");
+    }
+    if (isSelected("velocity")) {
+        loaded &= state.readColumn<double>("velocity", 3, [this](size_t p, double const *values) {
+            particleNodes[p].velocity = glm::make_vec3(values);
+        }) || isAbsent("velocity");
+    }
+    for (auto const &column : lavaParticleScalarColumns) {
+        if (!isSelected(column.name)) continue;
+        auto member = column.member;
+        loaded &= state.readColumn<double>(column.name, 1, [this, member](size_t p, double const *values) {
+            particleNodes[p].*member = values[0];
+        }) || isAbsent(column.name);
+    }
+    if (isSelected("deformElastic")) {
+        loaded &= state.readColumn<double>("deformElastic", 9, [this](size_t p, double const *values) {
+            particleNodes[p].deformElastic = glm::make_mat3(values);
+        }) || isAbsent("deformElastic");
+    }
+    if (isSelected("deformPlastic")) {
+        loaded &= state.readColumn<double>("deformPlastic", 9, [this](size_t p, double const *values) {
+            particleNodes[p].deformPlastic = glm::make_mat3(values);
+        }) || isAbsent("deformPlastic");
     }
 
-    file.close();
+    simulationParametersDidUpdate = true;
+    return loaded;
 }
 
-void LavaSolver::loadState(std::string const &filename) {
-    std::ifstream file(filename, std::ifstream::binary);
+bool LavaSolver::loadLegacyState(std::string const &filename) {
+    MappedFile file(filename);
+    if (!file.isOpen() || file.size() < sizeof(LAVA_SOLVER_STATE_HEADER)) {
+        LOG(ERROR) << "Unable to read state file " << filename << std::endl;
+        return false;
+    }
 
     LavaParticleNode emptyParticleNode{{},
                                        {}};
 
-    LAVA_SOLVER_STATE_HEADER solverStateHeader{};
-    file.read(reinterpret_cast<char *>(&solverStateHeader), sizeof(LAVA_SOLVER_STATE_HEADER));
+    auto const &solverStateHeader = *reinterpret_cast<LAVA_SOLVER_STATE_HEADER const *>(file.data());
     if (solverStateHeader.type != 'LA') {
         LOG(ERROR) << "Unexpected file type" << std::endl;
-        return;
+        return false;
+    }
+
+    if (file.size() < sizeof(LAVA_SOLVER_STATE_HEADER) +
+                      solverStateHeader.numParticles * sizeof(LAVA_SOLVER_STATE_PARTICLE)) {
+        LOG(ERROR) << "Unable to read state file " << filename << std::endl;
+        return false;
     }
 
     h = solverStateHeader.h;
     size = solverStateHeader.size;
     tick = solverStateHeader.tick;
     delta_t = solverStateHeader.delta_t;
+    time = tick * delta_t;
     alpha = solverStateHeader.alpha;
     particleNodes.resize(solverStateHeader.numParticles, emptyParticleNode);
 
-    LAVA_SOLVER_STATE_PARTICLE particleState{};
-    for (auto &particleNode : particleNodes) {
-        file.read(reinterpret_cast<char *>(&particleState), sizeof(LAVA_SOLVER_STATE_PARTICLE));
+    auto particleStates = reinterpret_cast<LAVA_SOLVER_STATE_PARTICLE const *>(file.data() +
+                                                                               sizeof(LAVA_SOLVER_STATE_HEADER));
+
+    auto numParticleNodes = particleNodes.size();
+    for (auto p = 0; p < numParticleNodes; p++) {
+        auto &particleNode = particleNodes[p];
+        auto const &particleState = particleStates[p];
 
         particleNode.position = particleState.position;
         particleNode.velocity = particleState.velocity;
@@ -1192,7 +1544,6 @@ void LavaSolver::loadState(std::string const &filename) {
         particleNode.deformPlastic = particleState.deformPlastic;
     }
 
-    file.close();
-
     simulationParametersDidUpdate = true;
+    return true;
 }
@@ -8,11 +8,14 @@
 #include "LavaGridCellNode.h"
 #include "LavaGridFaceNode.h"
 #include "Solver.h"
+#include "StateFile.h"
 
 
 class LavaSolver : public Solver {
 public:
 
+    // Unversioned state layout written before StateFile, still loaded
+
     struct LAVA_SOLVER_STATE_HEADER {
         unsigned short type; // LA
         unsigned int headerSize;
@@ -54,9 +57,40 @@ public:
 
     void update();
 
-    void saveState(std::string const &filename);
-
-    void loadState(std::string const &filename);
+    /**
+     * Bytes of every structure, with the grids and the workspaces of the solves at the size the next update needs,
+     * so a scene can be sized from its grid size and particles before the first update
+     */
+    std::vector<SolverMemoryUsage> memoryUsage() const;
+
+    /**
+     * Serializes the state as a StateFile into buffer
+     * The buffer is only grown, so it can be reused across frames
+     * Lossy compression quantizes positions to 1/65535 of the largest grid dimension
+     * Consecutive frames are delta encoded against keyframes if they are given
+     * Only the listed particle columns are written, or all of them if none are listed
+     */
+    size_t packState(std::vector<char> &buffer, StateFileCompression compression = STATE_FILE_UNCOMPRESSED,
+                     StateFileKeyframes *keyframes = nullptr, std::vector<std::string> const &fields = {});
+
+    /**
+     * Particle columns read by viz, enough for frames that are not resumed from
+     */
+    static std::vector<std::string> const vizFields;
+
+    /**
+     * Writes the state with a single write, returns the number of bytes written (0 on failure)
+     */
+    size_t saveState(std::string const &filename, StateFileCompression compression = STATE_FILE_UNCOMPRESSED);
+
+    /**
+     * Loads the parameters and the listed particle columns, or all of them if none are listed
+     * Particles keep their current values for columns that are not loaded
+     * Returns false if the file could not be read as a state of this solver
+     */
+    bool loadState(std::string const &filename, std::vector<std::string> const &fields = {});
+
+    bool loadState(StateFileView const &state, std::vector<std::string> const &fields = {});
 
     bool (*isNodeColliding)(Node &node);
 
@@ -67,9 +101,21 @@ public:
     }
 
     double getTime() {
-        return tick * delta_t;
+        return time;
     }
 
+    /**
+     * Largest time step under the CFL condition, no particle moving faster than cfl grid cells per tick, neither by
+     * its velocity nor by the elastic waves it carries
+     */
+    double cflTimeStep();
+
+    /**
+     * Picks delta_t for the next tick, the tick ending at endTime at the latest
+     * Fixed time steps are only shortened on the last tick before endTime
+     */
+    void chooseTimeStep(double endTime);
+
     unsigned int getGridCellNodeIndex(unsigned int x, unsigned int y, unsigned int z) {
         return (x * size.y + y) * size.z + z;
     }
@@ -90,28 +136,16 @@ public:
         return gridCellNodes[getGridCellNodeIndex(x, y, z)];
     }
 
-    LavaGridFaceNode &gridFaceXNode(unsigned int x, unsigned int y, unsigned int z) {
-        return gridFaceXNodes[getGridFaceXNodeIndex(x, y, z)];
-    }
-
-    LavaGridFaceNode &gridFaceYNode(unsigned int x, unsigned int y, unsigned int z) {
-        return gridFaceYNodes[getGridFaceYNodeIndex(x, y, z)];
+    glm::dvec3 getGridFaceXNodePosition(unsigned int x, unsigned int y, unsigned int z) {
+        return glm::dvec3(x - 0.5, y, z) * h;
     }
 
-    LavaGridFaceNode &gridFaceZNode(unsigned int x, unsigned int y, unsigned int z) {
-        return gridFaceZNodes[getGridFaceZNodeIndex(x, y, z)];
+    glm::dvec3 getGridFaceYNodePosition(unsigned int x, unsigned int y, unsigned int z) {
+        return glm::dvec3(x, y - 0.5, z) * h;
     }
 
-    LavaGridFaceNode &gridFaceXNode(glm::uvec3 location) {
-        return gridFaceXNodes[getGridFaceXNodeIndex(location.x, location.y, location.z)];
-    }
-
-    LavaGridFaceNode &gridFaceYNode(glm::uvec3 location) {
-        return gridFaceYNodes[getGridFaceYNodeIndex(location.x, location.y, location.z)];
-    }
-
-    LavaGridFaceNode &gridFaceZNode(glm::uvec3 location) {
-        return gridFaceZNodes[getGridFaceZNodeIndex(location.x, location.y, location.z)];
+    glm::dvec3 getGridFaceZNodePosition(unsigned int x, unsigned int y, unsigned int z) {
+        return glm::dvec3(x, y, z - 0.5) * h;
     }
 
     bool isValidGridCellNode(unsigned int x, unsigned int y, unsigned int z) {
@@ -246,17 +280,61 @@ public:
         }
     }
 
+    struct TemperatureBatch {
+        std::vector<double> temperature; // [degC]
+        std::vector<double> latentHeat; // [J]
+        std::vector<double> temperatureDifference; // [degC]
+
+        // Material properties
+        std::vector<double> mass;
+        std::vector<double> specificHeat;
+        std::vector<double> fusionTemperature;
+        std::vector<double> latentHeatOfFusion;
+
+        void resize(size_t count) {
+            temperature.resize(count);
+            latentHeat.resize(count);
+            temperatureDifference.resize(count);
+            mass.resize(count);
+            specificHeat.resize(count);
+            fusionTemperature.resize(count);
+            latentHeatOfFusion.resize(count);
+        }
+    };
+
+    /**
+     * Batch variant of applyTemperatureDifference
+     * Every phase regime is evaluated and the result selected per element, so the loop has no branches to vectorize
+     */
+    static void applyTemperatureDifferences(TemperatureBatch &batch);
+
+    /**
+     * Elements [begin, end) of the batch, on the calling thread
+     */
+    static void applyTemperatureDifferences(TemperatureBatch &batch, size_t begin, size_t end);
+
+    enum HeatIntegration {
+        AUTO_HEAT_INTEGRATION, // Picks whichever of the two below is estimated to be cheaper, every tick
+        IMPLICIT_HEAT_INTEGRATION, // Default, stable at any step
+        EXPLICIT_HEAT_INTEGRATION // Substepped below the stability limit
+    };
+
     // Simulation parameters
 
     double alpha = 0.95; // PIC/FLIP
 
+    HeatIntegration heatIntegration = IMPLICIT_HEAT_INTEGRATION;
+
     // Grid
     double h;
     glm::uvec3 size;
 
     // Time
     unsigned int tick = 0;
-    double delta_t = 5e-3;
+    double time = 0;
+    double delta_t = 5e-3; // Of the next tick
+    double cfl = 0; // Adaptive time steps if positive, see chooseTimeStep
+    double maxDelta_t = 0; // Fixed time step, or upper bound of adaptive ones, the initial delta_t if 0
 
     // Record keeping
 
@@ -264,6 +342,9 @@ public:
 
 private:
 
+    friend class SolverBenchmarks; // Times the private kernels, see bench/
+    friend class SolverTests; // Checks the private steps, see tests/
+
     // Dependent values on simulation parameters
 
     double invh;
@@ -271,12 +352,71 @@ private:
     // Cell-centered
     std::vector<LavaGridCellNode> gridCellNodes;
     // Staggered
-    std::vector<LavaGridFaceNode> gridFaceXNodes;
-    std::vector<LavaGridFaceNode> gridFaceYNodes;
-    std::vector<LavaGridFaceNode> gridFaceZNodes;
+    LavaGridFaceNodes gridFaceXNodes;
+    LavaGridFaceNodes gridFaceYNodes;
+    LavaGridFaceNodes gridFaceZNodes;
+
+    // Cell classification, maintained incrementally from face occupancy changes
+    std::vector<unsigned int> dirtyGridCellNodes;
+    std::vector<unsigned int> collidingGridCellNodes;
+    std::vector<unsigned int> interiorGridCellNodes;
+
+    // Particle temperatures staged for the phase change kernel
+    TemperatureBatch temperatureBatch;
+
+    // Serialized state, reused across saves
+    std::vector<char> stateBuffer;
+
+    // Explicit heat integration fell back to implicit, which is only logged the first time
+    bool explicitHeatIntegrationFellBack = false;
 
     // Helper methods
 
+    bool loadLegacyState(std::string const &filename);
+
+    void markGridFaceXNodeCells(unsigned int x, unsigned int y, unsigned int z);
+
+    void markGridFaceYNodeCells(unsigned int x, unsigned int y, unsigned int z);
+
+    void markGridFaceZNodeCells(unsigned int x, unsigned int y, unsigned int z);
+
+    // Faces only carry one velocity component, so the scene callbacks see a node holding just that component
+
+    bool isGridFaceNodeColliding(glm::dvec3 const &position) {
+        Node node(position);
+        return isNodeColliding(node);
+    }
+
+    double handleGridFaceNodeCollisionVelocityUpdate(glm::dvec3 const &position, unsigned int axis,
+                                                     double velocity_star) {
+        Node node(position);
+        node.velocity_star[axis] = velocity_star;
+        handleNodeCollisionVelocityUpdate(node);
+        return node.velocity_star[axis];
+    }
+
+    LavaGridCellNodeType classifyGridCellNode(LavaGridCellNode const &cellNode);
+
+    void classifyGridCellNodes();
+
+    /**
+     * Rate of temperature change of a cell due to conduction through its faces, for the temperatures x
+     */
+    double heatDiffusion(std::vector<double> const &x, size_t c);
+
+    /**
+     * Integrates the cell temperatures x over delta_t into next_x, as chosen by heatIntegration
+     * x is used as scratch by the explicit substeps
+     */
+    void integrateHeat(std::vector<double> &next_x, std::vector<double> &x);
+
+    /**
+     * Largest step the explicit heat integration is stable for
+     */
+    double explicitHeatIntegrationTimeStepLimit();
+
+    void explicitHeatIntegrationStep(std::vector<double> &next_x, std::vector<double> const &x, double dt);
+
     void implicitHeatIntegrationMatrix(std::vector<double> &Ax, std::vector<double> const &x);
 
     void implicitPressureIntegrationMatrix(std::vector<double> &Ax, std::vector<double> const &x);
@@ -325,11 +465,32 @@ private:
         return invh * glm::dvec3(dnx * ny * nz, nx * dny * nz, nx * ny * dnz);
     }
 
-    double weight(LavaGridCellNode const &i, LavaParticleNode const &p) {
-        return n(i.position, p.position);
+    /**
+     * Tight kernel gradients over the 4x4x4 stencil whose first node sits at stencilPosition
+     * The kernel is separable, so the 1D weights are evaluated once per axis and combined for all 64 nodes
+     */
+    void tight_nabla_n(glm::dvec3 const &stencilPosition, glm::dvec3 const &particlePosition, glm::dvec3 *nabla) {
+        double n[3][4];
+        double dn[3][4];
+        for (auto d = 0; d < 3; d++) {
+            auto x = invh * (particlePosition[d] - stencilPosition[d]);
+            for (auto k = 0; k < 4; k++) {
+                n[d][k] = tight_n(x - k);
+                dn[d][k] = tight_del_n(x - k);
+            }
+        }
+
+        for (unsigned int i = 0; i < 64; i++) {
+            auto ix = i / 16;
+            auto iy = (i / 4) % 4;
+            auto iz = i % 4;
+            nabla[i] = invh * glm::dvec3(dn[0][ix] * n[1][iy] * n[2][iz],
+                                         n[0][ix] * dn[1][iy] * n[2][iz],
+                                         n[0][ix] * n[1][iy] * dn[2][iz]);
+        }
     }
 
-    double weight(LavaGridFaceNode const &i, LavaParticleNode const &p) {
+    double weight(LavaGridCellNode const &i, LavaParticleNode const &p) {
         return n(i.position, p.position);
     }
 
@@ -341,14 +502,6 @@ private:
         return nabla_n(i.position, p.position);
     }
 
-    glm::dvec3 nabla_weight(LavaGridFaceNode const &i, LavaParticleNode const &p) {
-        return nabla_n(i.position, p.position);
-    }
-
-    glm::dvec3 tight_nabla_weight(LavaGridFaceNode const &i, LavaParticleNode const &p) {
-        return tight_nabla_n(i.position, p.position);
-    }
-
 };
 
 
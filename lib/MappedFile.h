@@ -0,0 +1,94 @@
+#ifndef SNOW_MAPPEDFILE_H
+#define SNOW_MAPPEDFILE_H
+
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/**
+ * Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+
+    MappedFile() = default;
+
+    explicit MappedFile(std::string const &filename) {
+        open(filename);
+    }
+
+    MappedFile(MappedFile const &) = delete;
+
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    /**
+     * Maps a file, replacing the current mapping
+     * Fails if the file cannot be opened, is empty or cannot be mapped
+     */
+    bool open(std::string const &filename) {
+        close();
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat fileStat{};
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void *address = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // The mapping keeps the file referenced
+        if (address == MAP_FAILED) return false;
+
+        mapping = static_cast<char const *>(address);
+        length = static_cast<size_t>(fileStat.st_size);
+
+        return true;
+    }
+
+    void close() {
+        if (mapping) munmap(const_cast<char *>(mapping), length);
+        mapping = nullptr;
+        length = 0;
+    }
+
+    bool isOpen() const {
+        return mapping != nullptr;
+    }
+
+    char const *data() const {
+        return mapping;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    /**
+     * Hints the kernel that a range will be read front to back
+     */
+    void adviseSequential(size_t offset, size_t bytes) const {
+        auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto begin = offset / pageSize * pageSize;
+        madvise(const_cast<char *>(mapping) + begin, offset + bytes - begin, MADV_SEQUENTIAL);
+    }
+
+private:
+
+    char const *mapping = nullptr;
+    size_t length = 0;
+
+};
+
+
+#endif //SNOW_MAPPEDFILE_H
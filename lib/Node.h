@@ -15,7 +15,6 @@ struct Node {
 
     double mass{};
 
-    // TODO: The 3d velocity is somewhat a waste for LavaGridFaceNode since there's only one degree of freedom
     glm::dvec3 velocity{};
     glm::dvec3 velocity_star{}; // Intermediate velocity (for collision handling)
 
@@ -0,0 +1,131 @@
+#include "PerfCounters.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "logging.h"
+
+
+char const *const PerfCounters::names[PERF_COUNTERS] = {"cycles", "instructions", "llc_misses", "branch_misses"};
+
+#ifdef __linux__
+
+/**
+ * Counts an event of the calling thread, in user space only, returns -1 if it cannot
+ */
+static int openPerfCounter(unsigned int counter) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (counter) {
+        case PERF_CYCLES:
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PERF_BRANCH_MISSES:
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        default:
+            return -1;
+    }
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+bool PerfCounters::open() {
+    close();
+
+#ifdef _OPENMP
+    auto numThreads = omp_get_max_threads();
+#else
+    auto numThreads = 1;
+#endif
+
+    std::vector<std::array<int, PERF_COUNTERS>> counters(numThreads);
+
+#pragma omp parallel for schedule(static, 1) num_threads(numThreads)
+    for (auto t = 0; t < numThreads; t++) {
+        for (auto c = 0; c < PERF_COUNTERS; c++) {
+            counters[t][c] = openPerfCounter(c);
+        }
+    }
+
+    auto isAnyAvailable = false;
+    for (auto c = 0; c < PERF_COUNTERS; c++) {
+        available[c] = true;
+        for (auto const &fds : counters) available[c] = available[c] && fds[c] >= 0;
+        isAnyAvailable = isAnyAvailable || available[c];
+
+        if (!available[c]) LOG(INFO) << "Counter " << names[c] << " is unavailable" << std::endl;
+    }
+
+    // Counters missing on some threads would be partial
+    for (auto &fds : counters) {
+        for (auto c = 0; c < PERF_COUNTERS; c++) {
+            if (!available[c] && fds[c] >= 0) ::close(fds[c]);
+            if (!available[c]) fds[c] = -1;
+        }
+    }
+
+    if (isAnyAvailable) threadCounters.swap(counters);
+    return isAnyAvailable;
+}
+
+void PerfCounters::close() {
+    for (auto const &fds : threadCounters) {
+        for (auto fd : fds) {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+    threadCounters.clear();
+    std::fill(available, available + PERF_COUNTERS, false);
+}
+
+void PerfCounters::read(uint64_t (&values)[PERF_COUNTERS]) const {
+    for (auto c = 0; c < PERF_COUNTERS; c++) {
+        values[c] = 0;
+        for (auto const &fds : threadCounters) {
+            uint64_t value[3]; // Count, time enabled, time running
+            if (fds[c] < 0 || ::read(fds[c], value, sizeof(value)) != sizeof(value)) continue;
+            values[c] += value[2] > 0 && value[2] < value[1] ?
+                         static_cast<uint64_t>(static_cast<double>(value[0]) * value[1] / value[2]) : value[0];
+        }
+    }
+}
+
+#else
+
+bool PerfCounters::open() {
+    LOG(INFO) << "Hardware counters are only read on Linux" << std::endl;
+    return false;
+}
+
+void PerfCounters::close() {
+
+}
+
+void PerfCounters::read(uint64_t (&values)[PERF_COUNTERS]) const {
+    std::fill(values, values + PERF_COUNTERS, 0);
+}
+
+#endif
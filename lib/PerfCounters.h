@@ -0,0 +1,72 @@
+#ifndef SNOW_PERFCOUNTERS_H
+#define SNOW_PERFCOUNTERS_H
+
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+
+#define PERF_COUNTERS 4
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES, // Last level cache
+    PERF_BRANCH_MISSES
+};
+
+
+/**
+ * Hardware counters of the process, read through Linux perf_event_open
+ *
+ * Every OpenMP thread counts its own events, and reading sums them, so parallel steps are counted in full as long as
+ * they run on the threads the counters were opened on (OpenMP reuses the threads of teams of the same size).
+ * Counters that the CPU, the kernel or its perf_event_paranoid setting do not allow are left out, and without any
+ * of them the counters do not open at all.
+ */
+class PerfCounters {
+public:
+
+    static char const *const names[PERF_COUNTERS];
+
+    PerfCounters() = default;
+
+    PerfCounters(PerfCounters const &) = delete;
+
+    PerfCounters &operator=(PerfCounters const &) = delete;
+
+    ~PerfCounters() {
+        close();
+    }
+
+    /**
+     * Opens the counters on every OpenMP thread, fails if none is available
+     */
+    bool open();
+
+    void close();
+
+    bool isOpen() const {
+        return !threadCounters.empty();
+    }
+
+    bool isAvailable(unsigned int counter) const {
+        return available[counter];
+    }
+
+    /**
+     * Counts since the counters were opened, summed over the threads and scaled up if the kernel had to multiplex
+     * them, 0 for unavailable counters
+     */
+    void read(uint64_t (&values)[PERF_COUNTERS]) const;
+
+private:
+
+    std::vector<std::array<int, PERF_COUNTERS>> threadCounters; // File descriptors, -1 if unavailable
+    bool available[PERF_COUNTERS] = {};
+
+};
+
+
+#endif //SNOW_PERFCOUNTERS_H
@@ -0,0 +1,22 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+size_t Profiler::phase(char const *name) {
+    for (auto i = 0; i < phases.size(); i++) {
+        if (phases[i].name == name || strcmp(phases[i].name, name) == 0) return i;
+    }
+
+    phases.push_back({name, 0, 0, {}});
+    return phases.size() - 1;
+}
+
+void Profiler::reset() {
+    for (auto &phase : phases) {
+        phase.calls = 0;
+        phase.seconds = 0;
+        std::fill_n(phase.counters, PERF_COUNTERS, 0);
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef SNOW_PROFILER_H
+#define SNOW_PROFILER_H
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "PerfCounters.h"
+#include "Trace.h"
+
+
+/**
+ * Wall time spent in the named phases of solver updates, accumulated until reset, e.g. once per frame
+ * Phases are identified by their name, which must outlive the profiler (string literals)
+ */
+class Profiler {
+public:
+
+    typedef TraceSink::clock clock;
+
+    TraceSink *trace = nullptr; // Also records every phase as an event if set
+    PerfCounters *counters = nullptr; // Also counts hardware events per phase if set
+
+    struct Phase {
+        char const *name;
+        uint64_t calls;
+        double seconds;
+        uint64_t counters[PERF_COUNTERS];
+    };
+
+    /**
+     * Index of a phase, added on first use
+     */
+    size_t phase(char const *name);
+
+    void add(size_t phase, double seconds) {
+        phases[phase].calls++;
+        phases[phase].seconds += seconds;
+    }
+
+    void addCounters(size_t phase, uint64_t const (&start)[PERF_COUNTERS], uint64_t const (&end)[PERF_COUNTERS]) {
+        for (auto c = 0; c < PERF_COUNTERS; c++) {
+            phases[phase].counters[c] += end[c] - start[c];
+        }
+    }
+
+    /**
+     * Phases in the order they were first used
+     */
+    std::vector<Phase> const &getPhases() const {
+        return phases;
+    }
+
+    /**
+     * Clears the accumulated times, keeping the phases
+     */
+    void reset();
+
+private:
+
+    std::vector<Phase> phases;
+
+};
+
+
+/**
+ * Times a phase until the end of its scope, or until the next phase of the same scope starts
+ * Does nothing without a profiler, so solvers can be timed at the cost of a branch per phase
+ */
+class ProfilerScope {
+public:
+
+    ProfilerScope(Profiler *profiler, char const *name = nullptr) : profiler(profiler) {
+        next(name);
+    }
+
+    ProfilerScope(ProfilerScope const &) = delete;
+
+    ProfilerScope &operator=(ProfilerScope const &) = delete;
+
+    ~ProfilerScope() {
+        next(nullptr);
+    }
+
+    /**
+     * Ends the current phase and starts the named one, if any
+     */
+    void next(char const *name) {
+        if (!profiler) return;
+
+        // Read once, ending the current phase and starting the next one
+        uint64_t counters[PERF_COUNTERS];
+        if (profiler->counters) profiler->counters->read(counters);
+
+        auto now = Profiler::clock::now();
+        if (this->name) {
+            profiler->add(phase, std::chrono::duration<double>(now - start).count());
+            if (profiler->counters) profiler->addCounters(phase, startCounters, counters);
+            if (profiler->trace) {
+                profiler->trace->complete(this->name, "solver", start, now, argumentName, argumentValue);
+            }
+        }
+
+        this->name = name;
+        argumentName = nullptr;
+        if (name) {
+            phase = profiler->phase(name);
+            if (profiler->counters) std::copy_n(counters, PERF_COUNTERS, startCounters);
+            start = Profiler::clock::now();
+        }
+    }
+
+    /**
+     * Attaches a value to the trace event of the current phase, e.g. a number of iterations
+     */
+    void setArgument(char const *name, double value) {
+        argumentName = name;
+        argumentValue = value;
+    }
+
+private:
+
+    Profiler *profiler;
+
+    char const *name = nullptr; // Of the current phase
+    size_t phase = 0;
+    Profiler::clock::time_point start;
+    uint64_t startCounters[PERF_COUNTERS];
+
+    char const *argumentName = nullptr;
+    double argumentValue = 0;
+
+};
+
+
+#endif //SNOW_PROFILER_H
@@ -11,7 +11,7 @@ struct SnowParticleNode : public Node {
         this->mass = mass;
     }
 
-    double volume0;
+    double volume0{};
 
     glm::dmat3 deformElastic = glm::dmat3(1);
     glm::dmat3 deformPlastic = glm::dmat3(1);
@@ -1,15 +1,13 @@
 #include "SnowSolver.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 
 #include <glm/gtc/type_ptr.hpp>
-#include <Dense>
 
 #include "conjugate_residual_solver.h"
-
-
-typedef Eigen::Matrix<double, 3, 3> eigen_matrix3;
-typedef Eigen::Matrix<double, 3, 1> eigen_vector3;
+#include "svd.h"
 
 
 SnowSolver::SnowSolver(double h, glm::uvec3 const &size) : h(h), size(size) {
@@ -20,44 +18,14 @@ SnowSolver::SnowSolver(std::string const &filename) {
     loadState(filename);
 }
 
-inline void svd(glm::dmat3 const &m, glm::dmat3 &u, glm::dvec3 &e, glm::dmat3 &v) {
-    Eigen::Map<eigen_matrix3 const> mmap(glm::value_ptr(m));
-    Eigen::Map<eigen_matrix3> umap(glm::value_ptr(u));
-    Eigen::Map<eigen_vector3> emap(glm::value_ptr(e));
-    Eigen::Map<eigen_matrix3> vmap(glm::value_ptr(v));
-
-    Eigen::JacobiSVD<eigen_matrix3, Eigen::NoQRPreconditioner> svd;
-    svd.compute(mmap, Eigen::ComputeFullV | Eigen::ComputeFullU);
-    umap = svd.matrixU();
-    emap = svd.singularValues();
-    vmap = svd.matrixV();
-}
-
-inline glm::dmat3 polarRot(glm::dmat3 const &m) {
-    glm::dmat3 u;
-    glm::dvec3 e;
-    glm::dmat3 v;
-    svd(m, u, e, v);
-    return u * glm::transpose(v);
-}
-
-inline void polarDecompose(glm::dmat3 const &m, glm::dmat3 &r, glm::dmat3 &s) {
-    glm::dmat3 u;
-    glm::dvec3 e;
-    glm::dmat3 v;
-    svd(m, u, e, v);
-    r = u * glm::transpose(v);
-    s = v * glm::dmat3(e.x, 0, 0, 0, e.y, 0, 0, 0, e.z) * glm::transpose(v);
-}
-
 void SnowSolver::propagateSimulationParametersUpdate() {
     simulationParametersDidUpdate = false;
 
-    lambda0 = youngsModulus0 * poissonsRatio / ((1 + poissonsRatio) * (1 - 2 * poissonsRatio));
-    mu0 = youngsModulus0 / (2 * (1 + poissonsRatio));
+    updateLameParameters();
     invh = 1 / h;
 
     gridNodes.clear();
+    gridNodes.reserve(size.x * size.y * size.z);
     for (auto x = 0; x < size.x; x++) {
         for (auto y = 0; y < size.y; y++) {
             for (auto z = 0; z < size.z; z++) {
@@ -70,10 +38,18 @@ void SnowSolver::propagateSimulationParametersUpdate() {
     LOG(INFO) << "#gridNodes=" << gridNodes.size() << std::endl;
 }
 
+void SnowSolver::updateLameParameters() {
+    lambda0 = youngsModulus0 * poissonsRatio / ((1 + poissonsRatio) * (1 - 2 * poissonsRatio));
+    mu0 = youngsModulus0 / (2 * (1 + poissonsRatio));
+}
+
 void SnowSolver::update() {
     LOG(INFO) << "delta_t=" << delta_t << " tick=" << tick << std::endl;
 
+    ProfilerScope phase(profiler);
+
     if (simulationParametersDidUpdate) {
+        phase.next("setup");
         propagateSimulationParametersUpdate();
     }
 
@@ -82,6 +58,8 @@ void SnowSolver::update() {
 
     // 1. Rasterize particle data to the grid //////////////////////////////////////////////////////////////////////////
 
+    phase.next("rasterize");
+
     LOG(VERBOSE) << "Step 1" << std::endl;
 
     for (auto i = 0; i < numGridNodes; i++) {
@@ -138,6 +116,8 @@ void SnowSolver::update() {
 
     if (tick == 0) {
 
+        phase.next("volumes");
+
         LOG(VERBOSE) << "Step 2" << std::endl;
 
         double totalDensity = 0;
@@ -187,6 +167,8 @@ void SnowSolver::update() {
 
     // 3
 
+    phase.next("forces");
+
     for (auto i = 0; i < numGridNodes; i++) {
         auto &gridNode = gridNodes[i];
 
@@ -224,6 +206,8 @@ void SnowSolver::update() {
 
     }
 
+    phase.next("grid_update");
+
     for (auto i = 0; i < numGridNodes; i++) {
         auto &gridNode = gridNodes[i];
 
@@ -245,6 +229,8 @@ void SnowSolver::update() {
 
     if (beta > 0) {
 
+        phase.next("linear_solve");
+
         std::vector<glm::dvec3> velocity_star(gridNodes.size());
         std::vector<glm::dvec3> velocity_next(gridNodes.size());
 
@@ -256,8 +242,12 @@ void SnowSolver::update() {
 
         }
 
-        conjugateResidualSolver(this, &SnowSolver::implicitVelocityIntegrationMatrix,
-                                velocity_next, velocity_star, 300);
+        {
+            ProfilerScope solve(profiler, "velocity_solve");
+            auto iterations = conjugateResidualSolver(this, &SnowSolver::implicitVelocityIntegrationMatrix,
+                                                      velocity_next, velocity_star, 300);
+            solve.setArgument("iterations", iterations);
+        }
 
         for (auto i = 0; i < numGridNodes; i++) {
             auto &gridNode = gridNodes[i];
@@ -273,6 +263,8 @@ void SnowSolver::update() {
     // 9. Particle-based body collisions ///////////////////////////////////////////////////////////////////////////////
     // 10. Update particle positions ///////////////////////////////////////////////////////////////////////////////////
 
+    phase.next("g2p");
+
     LOG(VERBOSE) << "Step 7, 8, 9, 10" << std::endl;
 
     for (auto p = 0; p < numParticleNodes; p++) {
@@ -349,9 +341,58 @@ void SnowSolver::update() {
     }
 
     tick++;
+    time += delta_t;
 
 }
 
+double SnowSolver::cflTimeStep() {
+    // The grid is left to update, only the wave speeds are needed here
+    updateLameParameters();
+
+    auto numParticleNodes = particleNodes.size();
+
+    // Grid velocities are mass weighted averages of particle velocities, so they are never faster
+    double maxSpeed = 0;
+
+#pragma omp parallel for reduction(max:maxSpeed)
+    for (auto p = 0; p < numParticleNodes; p++) {
+        auto const &particleNode = particleNodes[p];
+        auto speed = glm::length(particleNode.velocity);
+
+        // Volumes are computed on the first tick, before which particles are undeformed and carry no waves
+        auto jp = glm::determinant(particleNode.deformPlastic);
+        auto je = glm::determinant(particleNode.deformElastic);
+        if (particleNode.volume0 > 0 && particleNode.mass > 0 && je * jp > 0) {
+            // P-wave modulus over the current density
+            auto e = exp(hardeningCoefficient * (1 - jp));
+            speed += sqrt((lambda0 + 2 * mu0) * e * particleNode.volume0 * je * jp / particleNode.mass);
+        }
+
+        maxSpeed = std::max(maxSpeed, speed);
+    }
+
+    return maxSpeed > 0 ? cfl * h / maxSpeed : std::numeric_limits<double>::infinity();
+}
+
+void SnowSolver::chooseTimeStep(double endTime) {
+    if (maxDelta_t <= 0) maxDelta_t = delta_t;
+    delta_t = chooseSolverTimeStep(time, endTime, cfl, maxDelta_t, [this] { return cflTimeStep(); });
+}
+
+std::vector<SolverMemoryUsage> SnowSolver::memoryUsage() const {
+    auto numGridNodes = static_cast<size_t>(size.x) * size.y * size.z;
+
+    // The velocities of the linear solve, five vectors of the residual solver, two temporaries of its vector
+    // arithmetic, and two vectors of every matrix product
+    auto velocitySolve = beta > 0 ? 11 * numGridNodes * sizeof(glm::dvec3) : 0;
+
+    return {
+            {"particles",      particleNodes.capacity() * sizeof(SnowParticleNode)},
+            {"grid",           std::max(numGridNodes, gridNodes.capacity()) * sizeof(SnowGridNode)},
+            {"velocity_solve", velocitySolve},
+    };
+}
+
 inline double ddot(glm::dmat3 a, glm::dmat3 b) {
     return a[0][0] * b[0][0] + a[0][1] * b[0][1] + a[0][2] * b[0][2] +
            a[1][0] * b[1][0] + a[1][1] * b[1][1] + a[1][2] * b[1][2] +
@@ -510,49 +551,180 @@ SnowSolver::implicitVelocityIntegrationMatrix(std::vector<glm::dvec3> &Av_next,
 
 }
 
-void SnowSolver::saveState(std::string const &filename) {
+std::vector<std::string> const SnowSolver::vizFields = {"position"};
+
+size_t SnowSolver::packState(std::vector<char> &buffer, StateFileCompression compression,
+                            StateFileKeyframes *keyframes, std::vector<std::string> const &fields) {
+    StateFileWriter writer(buffer, STATE_FILE_SOLVER_SNOW, particleNodes.size(), compression, keyframes);
+
+    writer.addParameter("youngsModulus0", youngsModulus0);
+    writer.addParameter("criticalCompression", criticalCompression);
+    writer.addParameter("criticalStretch", criticalStretch);
+    writer.addParameter("hardeningCoefficient", hardeningCoefficient);
+    writer.addParameter("h", h);
+    writer.addParameter("sizeX", size.x);
+    writer.addParameter("sizeY", size.y);
+    writer.addParameter("sizeZ", size.z);
+    writer.addParameter("tick", tick);
+    writer.addParameter("time", time);
+    writer.addParameter("delta_t", delta_t);
+    writer.addParameter("cfl", cfl);
+    writer.addParameter("maxDelta_t", maxDelta_t);
+    writer.addParameter("alpha", alpha);
+    writer.addParameter("beta", beta);
+
+    auto isSelected = [&fields](char const *name) {
+        return fields.empty() || std::find(fields.begin(), fields.end(), name) != fields.end();
+    };
+
+    // Particles stay within the grid
+    auto positionQuantization = h * std::max(size.x, std::max(size.y, size.z)) / 65535;
+
+    if (isSelected("position")) {
+        writer.addColumn<double>("position", 3, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].position), 3, values);
+        }, positionQuantization);
+    }
+    if (isSelected("velocity")) {
+        writer.addColumn<double>("velocity", 3, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].velocity), 3, values);
+        });
+    }
+    if (isSelected("mass")) {
+        writer.addColumn<double>("mass", 1, [this](size_t p, double *values) {
+            values[0] = particleNodes[p].mass;
+        });
+    }
+    if (isSelected("volume0")) {
+        writer.addColumn<double>("volume0", 1, [this](size_t p, double *values) {
+            values[0] = particleNodes[p].volume0;
+        });
+    }
+    if (isSelected("deformElastic")) {
+        writer.addColumn<double>("deformElastic", 9, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].deformElastic), 9, values);
+        });
+    }
+    if (isSelected("deformPlastic")) {
+        writer.addColumn<double>("deformPlastic", 9, [this](size_t p, double *values) {
+            std::copy_n(glm::value_ptr(particleNodes[p].deformPlastic), 9, values);
+        });
+    }
+
+    return writer.finish();
+}
+
+size_t SnowSolver::saveState(std::string const &filename, StateFileCompression compression) {
+    auto bytes = packState(stateBuffer, compression);
+
     std::ofstream file;
     file.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    file.write(stateBuffer.data(), bytes);
+    file.close();
 
-    SNOW_SOLVER_STATE_HEADER solverStateHeader{
-            youngsModulus0,
-            criticalCompression,
-            criticalStretch,
-            hardeningCoefficient,
-            h,
-            size,
-            tick,
-            delta_t,
-            alpha,
-            beta,
-            particleNodes.size()
-    };
+    return file ? bytes : 0;
+}
 
-    file.write(reinterpret_cast<char *>(&solverStateHeader), sizeof(SNOW_SOLVER_STATE_HEADER));
+bool SnowSolver::loadState(std::string const &filename, std::vector<std::string> const &fields) {
+    StateFileView state(filename);
+    if (!state.isOpen()) {
+        return loadLegacyState(filename);
+    }
 
-    SNOW_SOLVER_STATE_PARTICLE particleState{};
-    for (auto const &particleNode : particleNodes) {
-        particleState.position = particleNode.position;
-        particleState.velocity = particleNode.velocity;
-        particleState.mass = particleNode.mass;
-        particleState.volume0 = particleNode.volume0;
-        particleState.deformElastic = particleNode.deformElastic;
-        particleState.deformPlastic = particleNode.deformPlastic;
+    return loadState(state, fields);
+}
 
-        file.write(reinterpret_cast<char *>(&particleState), sizeof(SNOW_SOLVER_STATE_PARTICLE));
+bool SnowSolver::loadState(StateFileView const &state, std::vector<std::string> const &fields) {
+    SnowParticleNode emptyParticleNode{{},
+                                       {}};
+
+    if (state.header().solver != STATE_FILE_SOLVER_SNOW) {
+        LOG(ERROR) << "Unexpected file type" << std::endl;
+        return false;
     }
 
-    file.close();
+    youngsModulus0 = state.parameter("youngsModulus0", youngsModulus0);
+    criticalCompression = state.parameter("criticalCompression", criticalCompression);
+    criticalStretch = state.parameter("criticalStretch", criticalStretch);
+    hardeningCoefficient = state.parameter("hardeningCoefficient", hardeningCoefficient);
+    h = state.parameter("h", h);
+    size = glm::uvec3(state.parameter("sizeX", size.x),
+                      state.parameter("sizeY", size.y),
+                      state.parameter("sizeZ", size.z));
+    tick = static_cast<unsigned int>(state.parameter("tick", tick));
+    delta_t = state.parameter("delta_t", delta_t);
+    time = state.parameter("time", tick * delta_t); // Steps were fixed before it was saved
+    cfl = state.parameter("cfl", cfl);
+    maxDelta_t = state.parameter("maxDelta_t", maxDelta_t);
+    alpha = state.parameter("alpha", alpha);
+    beta = state.parameter("beta", beta);
+    particleNodes.resize(state.numParticles(), emptyParticleNode);
+
+    auto isSelected = [&fields](char const *name) {
+        return fields.empty() || std::find(fields.begin(), fields.end(), name) != fields.end();
+    };
+
+    // Columns that were not asked for may be absent, e.g. all but the viz fields of viz frames, any other column that
+    // cannot be read fails the load
+    auto isAbsent = [&state, &fields](char const *name) {
+        if (fields.empty() && !state.column(name)) return true;
+        LOG(ERROR) << "Unable to read column " << name << std::endl;
+        return false;
+    };
+    auto loaded = true;
+
+    if (isSelected("position")) {
+        loaded &= state.readColumn<double>("position", 3, [this](size_t p, double const *values) {
+            particleNodes[p].position = glm::make_vec3(values);
+        }) || isAbsent("position");
+    }
+    if (isSelected("velocity")) {
+        loaded &= state.readColumn<double>("velocity", 3, [this](size_t p, double const *values) {
+            particleNodes[p].velocity = glm::make_vec3(values);
+        }) || isAbsent("velocity");
+    }
+    if (isSelected("mass")) {
+        loaded &= state.readColumn<double>("mass", 1, [this](size_t p, double const *values) {
+            particleNodes[p].mass = values[0];
+        }) || isAbsent("mass");
+    }
+    if (isSelected("volume0")) {
+        loaded &= state.readColumn<double>("volume0", 1, [this](size_t p, double const *values) {
+            particleNodes[p].volume0 = values[0];
+        }) || isAbsent("volume0");
+    }
+    if (isSelected("deformElastic")) {
+        loaded &= state.readColumn<double>("deformElastic", 9, [this](size_t p, double const *values) {
+            particleNodes[p].deformElastic = glm::make_mat3(values);
+        }) || isAbsent("deformElastic");
+    }
+    if (isSelected("deformPlastic")) {
+        loaded &= state.readColumn<double>("deformPlastic", 9, [this](size_t p, double const *values) {
+            particleNodes[p].deformPlastic = glm::make_mat3(values);
+        }) || isAbsent("deformPlastic");
+    }
+
+    simulationParametersDidUpdate = true;
+    return loaded;
 }
 
-void SnowSolver::loadState(std::string const &filename) {
-    std::ifstream file(filename, std::ifstream::binary);
+bool SnowSolver::loadLegacyState(std::string const &filename) {
+    MappedFile file(filename);
+    if (!file.isOpen() || file.size() < sizeof(SNOW_SOLVER_STATE_HEADER)) {
+        LOG(ERROR) << "Unable to read state file " << filename << std::endl;
+        return false;
+    }
 
     SnowParticleNode emptyParticleNode{{},
                                        {}};
 
-    SNOW_SOLVER_STATE_HEADER solverStateHeader{};
-    file.read(reinterpret_cast<char *>(&solverStateHeader), sizeof(SNOW_SOLVER_STATE_HEADER));
+    auto const &solverStateHeader = *reinterpret_cast<SNOW_SOLVER_STATE_HEADER const *>(file.data());
+    if (file.size() < sizeof(SNOW_SOLVER_STATE_HEADER) +
+                      solverStateHeader.numParticles * sizeof(SNOW_SOLVER_STATE_PARTICLE)) {
+        LOG(ERROR) << "Unable to read state file " << filename << std::endl;
+        return false;
+    }
+
     youngsModulus0 = solverStateHeader.youngsModulus0;
     criticalCompression = solverStateHeader.criticalCompression;
     criticalStretch = solverStateHeader.criticalStretch;
@@ -561,13 +733,18 @@ void SnowSolver::loadState(std::string const &filename) {
     size = solverStateHeader.size;
     tick = solverStateHeader.tick;
     delta_t = solverStateHeader.delta_t;
+    time = tick * delta_t;
     alpha = solverStateHeader.alpha;
     beta = solverStateHeader.beta;
     particleNodes.resize(solverStateHeader.numParticles, emptyParticleNode);
 
-    SNOW_SOLVER_STATE_PARTICLE particleState{};
-    for (auto &particleNode : particleNodes) {
-        file.read(reinterpret_cast<char *>(&particleState), sizeof(SNOW_SOLVER_STATE_PARTICLE));
+    auto particleStates = reinterpret_cast<SNOW_SOLVER_STATE_PARTICLE const *>(file.data() +
+                                                                               sizeof(SNOW_SOLVER_STATE_HEADER));
+
+    auto numParticleNodes = particleNodes.size();
+    for (auto p = 0; p < numParticleNodes; p++) {
+        auto &particleNode = particleNodes[p];
+        auto const &particleState = particleStates[p];
 
         particleNode.position = particleState.position;
         particleNode.velocity = particleState.velocity;
@@ -577,7 +754,6 @@ void SnowSolver::loadState(std::string const &filename) {
         particleNode.deformPlastic = particleState.deformPlastic;
     }
 
-    file.close();
-
     simulationParametersDidUpdate = true;
+    return true;
 }
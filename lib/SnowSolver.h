@@ -7,11 +7,14 @@
 #include "SnowParticleNode.h"
 #include "SnowGridNode.h"
 #include "Solver.h"
+#include "StateFile.h"
 
 
 class SnowSolver : public Solver {
 public:
 
+    // Unversioned state layout written before StateFile, still loaded
+
     struct SNOW_SOLVER_STATE_HEADER {
         double youngsModulus0; // 8
         double criticalCompression; // 8
@@ -45,9 +48,40 @@ public:
 
     void update();
 
-    void saveState(std::string const &filename);
-
-    void loadState(std::string const &filename);
+    /**
+     * Bytes of every structure, with the grids and the workspaces of the solves at the size the next update needs,
+     * so a scene can be sized from its grid size and particles before the first update
+     */
+    std::vector<SolverMemoryUsage> memoryUsage() const;
+
+    /**
+     * Serializes the state as a StateFile into buffer
+     * The buffer is only grown, so it can be reused across frames
+     * Lossy compression quantizes positions to 1/65535 of the largest grid dimension
+     * Consecutive frames are delta encoded against keyframes if they are given
+     * Only the listed particle columns are written, or all of them if none are listed
+     */
+    size_t packState(std::vector<char> &buffer, StateFileCompression compression = STATE_FILE_UNCOMPRESSED,
+                     StateFileKeyframes *keyframes = nullptr, std::vector<std::string> const &fields = {});
+
+    /**
+     * Particle columns read by viz, enough for frames that are not resumed from
+     */
+    static std::vector<std::string> const vizFields;
+
+    /**
+     * Writes the state with a single write, returns the number of bytes written (0 on failure)
+     */
+    size_t saveState(std::string const &filename, StateFileCompression compression = STATE_FILE_UNCOMPRESSED);
+
+    /**
+     * Loads the parameters and the listed particle columns, or all of them if none are listed
+     * Particles keep their current values for columns that are not loaded
+     * Returns false if the file could not be read as a state of this solver
+     */
+    bool loadState(std::string const &filename, std::vector<std::string> const &fields = {});
+
+    bool loadState(StateFileView const &state, std::vector<std::string> const &fields = {});
 
     void (*handleNodeCollisionVelocityUpdate)(Node &node);
 
@@ -56,9 +90,21 @@ public:
     }
 
     double getTime() {
-        return tick * delta_t;
+        return time;
     }
 
+    /**
+     * Largest time step under the CFL condition, no particle moving faster than cfl grid cells per tick, neither by
+     * its velocity nor by the elastic waves it carries
+     */
+    double cflTimeStep();
+
+    /**
+     * Picks delta_t for the next tick, the tick ending at endTime at the latest
+     * Fixed time steps are only shortened on the last tick before endTime
+     */
+    void chooseTimeStep(double endTime);
+
     unsigned int getGridNodeIndex(unsigned int x, unsigned int y, unsigned int z) {
         return (x * size.y + y) * size.z + z;
     }
@@ -139,7 +185,10 @@ public:
 
     // Time
     unsigned int tick = 0;
-    double delta_t = 5e-3;
+    double time = 0;
+    double delta_t = 5e-3; // Of the next tick
+    double cfl = 0; // Adaptive time steps if positive, see chooseTimeStep
+    double maxDelta_t = 0; // Fixed time step, or upper bound of adaptive ones, the initial delta_t if 0
 
     // Record keeping
 
@@ -147,6 +196,8 @@ public:
 
 private:
 
+    friend class SolverBenchmarks; // Times the private kernels, see bench/
+
     double poissonsRatio = 0.2;
 
     // Dependent values on simulation parameters
@@ -156,8 +207,15 @@ private:
     double invh;
     std::vector<SnowGridNode> gridNodes;
 
+    // Serialized state, reused across saves
+    std::vector<char> stateBuffer;
+
     // Helper methods
 
+    bool loadLegacyState(std::string const &filename);
+
+    void updateLameParameters();
+
     void implicitVelocityIntegrationMatrix(std::vector<glm::dvec3> &Ax, std::vector<glm::dvec3> const &x);
 
     double n(glm::dvec3 const &gridPosition, glm::dvec3 const &particlePosition) {
@@ -2,7 +2,49 @@
 #define SNOW_SOLVER_H
 
 
+#include <algorithm>
+#include <cstddef>
+
+#include "Profiler.h"
+
+
+/**
+ * Bytes of a structure of a solver
+ */
+struct SolverMemoryUsage {
+    char const *name;
+    size_t bytes;
+};
+
+
+/**
+ * Time step of the next tick starting at time, the tick ending at endTime at the latest
+ * cflTimeStep() is only called for adaptive steps, when cfl is positive
+ * Fixed time steps are only shortened on the last tick before endTime
+ */
+template<typename F>
+inline double chooseSolverTimeStep(double time, double endTime, double cfl, double maxDelta_t, F const &cflTimeStep) {
+    auto delta_t = cfl > 0 ? std::min(maxDelta_t, cflTimeStep()) : maxDelta_t;
+
+    auto remaining = endTime - time;
+    if (remaining <= 0) return delta_t;
+
+    // Rounding must not leave a sliver of a tick after the last one
+    if (remaining <= delta_t * (1 + 1e-6)) {
+        delta_t = remaining;
+    } else if (cfl > 0 && remaining < 2 * delta_t) {
+        // Adaptive steps vary anyway, so the last two ticks share what remains
+        delta_t = remaining / 2;
+    }
+
+    return delta_t;
+}
+
+
 class Solver {
+public:
+
+    Profiler *profiler = nullptr; // Times the steps of update if set
 
 };
 
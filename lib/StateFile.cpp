@@ -0,0 +1,273 @@
+#include "StateFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+
+StateFileWriter::StateFileWriter(std::vector<char> &buffer, uint32_t solver, size_t numParticles,
+                                 StateFileCompression compression, StateFileKeyframes *keyframes)
+        : buffer(buffer), end(sizeof(STATE_FILE_HEADER)), solver(solver), numParticles(numParticles),
+          compression(compression), keyframes(keyframes) {
+
+    if (!keyframes) return;
+
+    keyframes->recording = !keyframes->hasKeyframe || keyframes->numParticles != numParticles ||
+                           keyframes->frame < keyframes->keyframe ||
+                           keyframes->frame - keyframes->keyframe >= keyframes->interval;
+    if (keyframes->recording) {
+        keyframes->hasKeyframe = true;
+        keyframes->keyframe = keyframes->frame;
+        keyframes->numParticles = numParticles;
+        keyframes->columns.clear();
+    }
+}
+
+void StateFileWriter::addParameter(std::string const &name, double value) {
+    STATE_FILE_PARAMETER parameter{};
+    copyName(parameter.name, name);
+    parameter.value = value;
+    parameters.push_back(parameter);
+}
+
+size_t StateFileWriter::finish() {
+    for (auto const &column : columns) {
+        if (column.codec & STATE_FILE_CODEC_DELTA) {
+            addParameter("keyframe", keyframes->keyframe);
+            break;
+        }
+    }
+
+    auto parametersBytes = parameters.size() * sizeof(STATE_FILE_PARAMETER);
+    auto columnsBytes = columns.size() * sizeof(STATE_FILE_COLUMN);
+
+    auto tableOffset = allocate(parametersBytes + columnsBytes);
+    memcpy(buffer.data() + tableOffset, parameters.data(), parametersBytes);
+    memcpy(buffer.data() + tableOffset + parametersBytes, columns.data(), columnsBytes);
+
+    STATE_FILE_HEADER header{};
+    memcpy(header.magic, STATE_FILE_MAGIC, sizeof(header.magic));
+    header.version = STATE_FILE_VERSION;
+    header.solver = solver;
+    header.numParameters = static_cast<uint32_t>(parameters.size());
+    header.numColumns = static_cast<uint32_t>(columns.size());
+    header.numParticles = numParticles;
+    header.tableOffset = tableOffset;
+    memcpy(buffer.data(), &header, sizeof(STATE_FILE_HEADER));
+
+    return end;
+}
+
+size_t StateFileWriter::allocate(size_t bytes) {
+    auto start = end;
+    auto offset = (start + STATE_FILE_ALIGNMENT - 1) / STATE_FILE_ALIGNMENT * STATE_FILE_ALIGNMENT;
+    end = offset + bytes;
+
+    // Grow geometrically, the first frame sizes the buffer for the following ones
+    if (buffer.size() < end) buffer.resize(std::max(end, 2 * buffer.size()));
+
+    // Clear the alignment padding so equal states serialize to equal bytes
+    std::fill(buffer.begin() + start, buffer.begin() + offset, 0);
+
+    return offset;
+}
+
+void StateFileWriter::encode(STATE_FILE_COLUMN &column, uint8_t const *values, size_t count, size_t elementSize,
+                             uint32_t codec, double quantization) {
+    auto bytes = count * elementSize;
+    auto input = values;
+
+    // Recorded before values, which may lie in the chunk, are overwritten by their encoding
+    if (keyframes && keyframes->recording) {
+        auto &reference = keyframes->columns[column.name];
+        reference.elementSize = elementSize;
+        reference.quantization = quantization;
+        reference.values.assign(values, values + bytes);
+    } else if (keyframes) {
+        auto reference = keyframes->columns.find(column.name);
+        if (reference != keyframes->columns.end() && reference->second.elementSize == elementSize &&
+            reference->second.quantization == quantization && reference->second.values.size() == bytes) {
+            auto &delta = keyframes->delta;
+            delta.resize(bytes);
+            auto referenceValues = reference->second.values.data();
+
+#pragma omp parallel for
+            for (auto i = 0; i < bytes; i++) {
+                delta[i] = values[i] ^ referenceValues[i];
+            }
+
+            input = delta.data();
+            codec = (codec == STATE_FILE_CODEC_RAW ? STATE_FILE_CODEC_SHUFFLE_LZ4 : codec) | STATE_FILE_CODEC_DELTA;
+        }
+    }
+
+    if (codec != STATE_FILE_CODEC_RAW) {
+        auto &encoded = keyframes ? keyframes->encoded : this->encoded;
+        auto encodedBytes = encodeColumn(input, count, elementSize, encoded);
+        if (encodedBytes < column.bytes) { // Incompressible columns stay raw
+            memcpy(buffer.data() + column.offset, encoded.data(), encodedBytes);
+            end = column.offset + encodedBytes;
+
+            column.codec = codec;
+            column.bytes = encodedBytes;
+            if (quantization > 0) column.quantization = quantization;
+        }
+    }
+
+    // Quantized columns that stayed raw hold other values than the following frames would refer to
+    if (keyframes && keyframes->recording && quantization > 0 && column.codec != codec) {
+        keyframes->columns.erase(column.name);
+    }
+}
+
+void StateFileWriter::copyName(char (&destination)[24], std::string const &name) {
+    LOG_ASSERT(name.size() < sizeof(destination));
+    strncpy(destination, name.c_str(), sizeof(destination) - 1);
+}
+
+/**
+ * Compares a name from a table, without trusting it to be NUL-terminated
+ */
+inline bool matchesName(char const (&stored)[24], std::string const &name) {
+    return name.size() < sizeof(stored) && strncmp(stored, name.c_str(), sizeof(stored)) == 0;
+}
+
+/**
+ * Replaces the frame number at the end of the file name, before its extension
+ */
+static bool keyframeFilename(std::string const &filename, uint64_t keyframe, std::string &keyframeFilename) {
+    auto nameBegin = filename.find_last_of('/');
+    nameBegin = nameBegin == std::string::npos ? 0 : nameBegin + 1;
+
+    auto numberEnd = filename.find_last_of('.');
+    if (numberEnd == std::string::npos || numberEnd < nameBegin) numberEnd = filename.size();
+
+    auto numberBegin = numberEnd;
+    while (numberBegin > nameBegin && isdigit(filename[numberBegin - 1])) numberBegin--;
+    if (numberBegin == numberEnd) return false;
+
+    keyframeFilename = filename.substr(0, numberBegin) + std::to_string(keyframe) + filename.substr(numberEnd);
+    return true;
+}
+
+/**
+ * Bytes per value as passed to the codec of a column
+ */
+static size_t codecElementSize(STATE_FILE_COLUMN const &column) {
+    if ((column.codec & ~STATE_FILE_CODEC_DELTA) == STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4) return sizeof(uint16_t);
+    return stateFileTypeSize(column.type);
+}
+
+bool StateFileView::open(std::string const &filename, bool isKeyframe) {
+    keyframeColumns.clear();
+
+    if (!file.open(filename)) {
+        keyframe.reset();
+        return false;
+    }
+
+    if (file.size() < sizeof(STATE_FILE_HEADER) ||
+        memcmp(header().magic, STATE_FILE_MAGIC, sizeof(header().magic)) != 0 ||
+        header().version > STATE_FILE_VERSION || header().tableOffset % sizeof(double) != 0 ||
+        header().tableOffset + header().numParameters * sizeof(STATE_FILE_PARAMETER) +
+        header().numColumns * sizeof(STATE_FILE_COLUMN) > file.size()) {
+        close();
+        return false;
+    }
+
+    auto isDelta = false;
+    for (auto c = 0; c < header().numColumns; c++) {
+        auto const &column = columns()[c];
+        auto valid = column.offset + column.bytes <= file.size();
+        switch (column.codec & ~STATE_FILE_CODEC_DELTA) {
+            case STATE_FILE_CODEC_RAW:
+                valid = valid && column.codec == STATE_FILE_CODEC_RAW && column.offset % sizeof(double) == 0 &&
+                        column.bytes >= numParticles() * column.components * stateFileTypeSize(column.type);
+                break;
+            case STATE_FILE_CODEC_SHUFFLE_LZ4:
+            case STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4:
+                break; // Checked when decoded
+            default:
+                valid = false;
+        }
+        isDelta = isDelta || (column.codec & STATE_FILE_CODEC_DELTA);
+        if (!valid || (isDelta && isKeyframe)) {
+            close();
+            return false;
+        }
+    }
+
+    std::string keyframeName;
+    if (!isDelta) {
+        keyframe.reset();
+    } else if (!keyframeFilename(filename, static_cast<uint64_t>(parameter("keyframe", -1)), keyframeName)) {
+        close();
+        return false;
+    } else if (!keyframe || keyframe->filename != keyframeName) {
+        keyframe.reset(new StateFileView());
+        if (!keyframe->open(keyframeName, true) || keyframe->numParticles() != numParticles()) {
+            close();
+            return false;
+        }
+    }
+
+    this->filename = filename;
+
+    return true;
+}
+
+double StateFileView::parameter(std::string const &name, double fallback) const {
+    for (auto i = 0; i < header().numParameters; i++) {
+        if (matchesName(parameters()[i].name, name)) return parameters()[i].value;
+    }
+    return fallback;
+}
+
+STATE_FILE_COLUMN const *StateFileView::column(std::string const &name) const {
+    for (auto i = 0; i < header().numColumns; i++) {
+        if (matchesName(columns()[i].name, name)) return &columns()[i];
+    }
+    return nullptr;
+}
+
+uint8_t const *StateFileView::columnData(STATE_FILE_COLUMN const &column, std::vector<uint8_t> &scratch) const {
+    file.adviseSequential(column.offset, column.bytes);
+
+    auto stored = reinterpret_cast<uint8_t const *>(file.data() + column.offset);
+    if (column.codec == STATE_FILE_CODEC_RAW) return stored;
+
+    auto count = numParticles() * column.components;
+    auto elementSize = codecElementSize(column);
+    scratch.resize(count * elementSize);
+    if (!decodeColumn(stored, column.bytes, count, elementSize, scratch.data())) return nullptr;
+
+    if (column.codec & STATE_FILE_CODEC_DELTA) {
+        auto reference = keyframe->column(column.name);
+        if (!reference || reference->type != column.type || reference->components != column.components ||
+            codecElementSize(*reference) != elementSize || reference->quantization != column.quantization) {
+            return nullptr;
+        }
+
+        auto referenceValues = keyframe->keyframeColumnData(*reference);
+        if (!referenceValues) return nullptr;
+
+#pragma omp parallel for
+        for (auto i = 0; i < scratch.size(); i++) {
+            scratch[i] ^= referenceValues[i];
+        }
+    }
+
+    return scratch.data();
+}
+
+uint8_t const *StateFileView::keyframeColumnData(STATE_FILE_COLUMN const &column) const {
+    if (column.codec == STATE_FILE_CODEC_RAW) return reinterpret_cast<uint8_t const *>(file.data() + column.offset);
+
+    auto decoded = keyframeColumns.find(column.name);
+    if (decoded != keyframeColumns.end()) return decoded->second.data();
+
+    auto &scratch = keyframeColumns[column.name];
+    auto values = columnData(column, scratch);
+    if (!values) keyframeColumns.erase(column.name);
+    return values;
+}
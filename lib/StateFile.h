@@ -0,0 +1,413 @@
+#ifndef SNOW_STATEFILE_H
+#define SNOW_STATEFILE_H
+
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logging.h"
+
+#include "MappedFile.h"
+#include "StateFileCodec.h"
+
+
+/**
+ * Solver state file format
+ *
+ * A fixed header, followed by one chunk per particle column, followed by the parameter and column tables. Every
+ * record has an explicit layout without compiler padding, and every chunk starts on a 64 byte boundary, so a
+ * reader can map the file and use or skip each column independently. Values are stored little-endian.
+ *
+ * Delta frames store some columns XOR-ed with the same column of a keyframe, another state file of the same
+ * sequence. Their "keyframe" parameter is the frame number of the keyframe, which is found by replacing the frame
+ * number in the file name, e.g. frame-12.snowstate refers to frame-10.snowstate.
+ */
+
+#define STATE_FILE_MAGIC "SNST"
+#define STATE_FILE_VERSION 2 // 2: column codecs
+#define STATE_FILE_ALIGNMENT 64
+
+enum StateFileSolver {
+    STATE_FILE_SOLVER_SNOW = 1,
+    STATE_FILE_SOLVER_LAVA = 2
+};
+
+enum StateFileCodec {
+    STATE_FILE_CODEC_RAW = 0,
+    STATE_FILE_CODEC_SHUFFLE_LZ4 = 1, // Lossless, see StateFileCodec.h
+    STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4 = 2, // Lossy, values rounded to 16 bit multiples of a step
+    STATE_FILE_CODEC_DELTA = 1 << 8 // Flag, values XOR-ed with the keyframe column before being compressed
+};
+
+/**
+ * How a writer encodes its columns
+ */
+enum StateFileCompression {
+    STATE_FILE_UNCOMPRESSED,
+    STATE_FILE_LOSSLESS, // For checkpoints
+    STATE_FILE_LOSSY // For viz frames, columns given a quantization step are quantized
+};
+
+enum StateFileType {
+    STATE_FILE_FLOAT32 = 1,
+    STATE_FILE_FLOAT64 = 2
+};
+
+struct STATE_FILE_HEADER {
+    char magic[4]; // STATE_FILE_MAGIC
+    uint32_t version;
+    uint32_t solver; // StateFileSolver
+    uint32_t numParameters;
+    uint32_t numColumns;
+    uint32_t reserved0;
+    uint64_t numParticles;
+    uint64_t tableOffset; // Parameter table, directly followed by the column table
+    uint64_t reserved1[3];
+};
+
+struct STATE_FILE_PARAMETER {
+    char name[24]; // NUL-terminated
+    double value;
+};
+
+struct STATE_FILE_COLUMN {
+    char name[24]; // NUL-terminated
+    uint32_t type; // StateFileType
+    uint32_t components; // Values per particle
+    uint32_t codec; // StateFileCodec
+    uint32_t reserved0;
+    uint64_t offset; // Of the chunk, from the start of the file
+    uint64_t bytes; // Of the chunk, as stored
+    double quantization; // Step of STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4
+};
+
+static_assert(sizeof(STATE_FILE_HEADER) == 64, "State file header must not be padded");
+static_assert(sizeof(STATE_FILE_PARAMETER) == 32, "State file parameter must not be padded");
+static_assert(sizeof(STATE_FILE_COLUMN) == 64, "State file column must not be padded");
+
+template<typename T>
+struct StateFileTypeOf;
+
+template<>
+struct StateFileTypeOf<float> {
+    static const uint32_t value = STATE_FILE_FLOAT32;
+};
+
+template<>
+struct StateFileTypeOf<double> {
+    static const uint32_t value = STATE_FILE_FLOAT64;
+};
+
+inline size_t stateFileTypeSize(uint32_t type) {
+    switch (type) {
+        case STATE_FILE_FLOAT32:
+            return sizeof(float);
+        case STATE_FILE_FLOAT64:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Columns of the last keyframe written, which the following frames are delta encoded against
+ * A frame becomes the keyframe every interval frames, and whenever the particle count changes
+ */
+class StateFileKeyframes {
+public:
+
+    explicit StateFileKeyframes(uint32_t interval) : interval(interval) {
+
+    }
+
+    /**
+     * Number of the frame written next
+     */
+    uint64_t frame = 0;
+
+    /**
+     * Bytes held by the keyframe columns and the scratch buffers of the writers
+     */
+    size_t memoryUsage() const {
+        auto bytes = delta.capacity() + encoded.capacity();
+        for (auto const &column : columns) {
+            bytes += column.second.values.capacity();
+        }
+        return bytes;
+    }
+
+private:
+
+    friend class StateFileWriter;
+
+    /**
+     * Values as passed to the codec, quantized or not
+     */
+    struct Column {
+        size_t elementSize;
+        double quantization;
+        std::vector<uint8_t> values;
+    };
+
+    uint32_t interval;
+
+    bool recording = false; // The frame being written is the keyframe
+    bool hasKeyframe = false;
+    uint64_t keyframe = 0;
+    size_t numParticles = 0;
+    std::map<std::string, Column> columns;
+
+    // Kept across frames, so the writers of the following frames reuse them
+    std::vector<uint8_t> delta;
+    std::vector<uint8_t> encoded;
+
+};
+
+
+/**
+ * Serializes a state file into a caller-owned buffer
+ * The buffer is only ever grown, so reusing it across frames avoids reallocating
+ */
+class StateFileWriter {
+public:
+
+    /**
+     * Frames are delta encoded against keyframes if they are given
+     */
+    StateFileWriter(std::vector<char> &buffer, uint32_t solver, size_t numParticles,
+                    StateFileCompression compression = STATE_FILE_UNCOMPRESSED,
+                    StateFileKeyframes *keyframes = nullptr);
+
+    void addParameter(std::string const &name, double value);
+
+    /**
+     * Adds a column of components values of type T per particle
+     * get(p, values) writes the values of particle p, it is called concurrently for different particles
+     * Lossy writers store the column as multiples of quantization if it is given, values must lie in
+     * [0, 65535 quantization]
+     */
+    template<typename T, typename F>
+    void addColumn(std::string const &name, uint32_t components, F const &get, double quantization = 0) {
+        auto count = numParticles * components;
+        auto bytes = count * sizeof(T);
+        auto offset = allocate(bytes);
+        auto values = reinterpret_cast<T *>(buffer.data() + offset);
+
+#pragma omp parallel for
+        for (auto p = 0; p < numParticles; p++) {
+            get(p, values + p * components);
+        }
+
+        STATE_FILE_COLUMN column{};
+        copyName(column.name, name);
+        column.type = StateFileTypeOf<T>::value;
+        column.components = components;
+        column.codec = STATE_FILE_CODEC_RAW;
+        column.offset = offset;
+        column.bytes = bytes;
+
+        if (compression == STATE_FILE_LOSSY && quantization > 0) {
+            std::vector<uint16_t> quantized(count);
+
+#pragma omp parallel for
+            for (auto i = 0; i < count; i++) {
+                auto step = std::round(values[i] / quantization);
+                quantized[i] = static_cast<uint16_t>(step < 0 ? 0 : step > 65535 ? 65535 : step);
+            }
+
+            encode(column, reinterpret_cast<uint8_t const *>(quantized.data()), count, sizeof(uint16_t),
+                   STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4, quantization);
+        } else {
+            encode(column, reinterpret_cast<uint8_t const *>(values), count, sizeof(T),
+                   compression == STATE_FILE_UNCOMPRESSED ? STATE_FILE_CODEC_RAW : STATE_FILE_CODEC_SHUFFLE_LZ4, 0);
+        }
+
+        columns.push_back(column);
+    }
+
+    /**
+     * Appends the tables and the header, returns the size of the file in the buffer
+     */
+    size_t finish();
+
+private:
+
+    std::vector<char> &buffer;
+    size_t end;
+
+    uint32_t solver;
+    size_t numParticles;
+    StateFileCompression compression;
+    StateFileKeyframes *keyframes;
+
+    std::vector<uint8_t> encoded; // Unless there are keyframes, which hold it along with the delta
+
+    std::vector<STATE_FILE_PARAMETER> parameters;
+    std::vector<STATE_FILE_COLUMN> columns;
+
+    size_t allocate(size_t bytes);
+
+    /**
+     * Replaces the raw chunk of the column, the last one allocated, by its encoding if that is smaller
+     * values are the input of the codec, and are recorded or delta encoded if there are keyframes
+     */
+    void encode(STATE_FILE_COLUMN &column, uint8_t const *values, size_t count, size_t elementSize, uint32_t codec,
+                double quantization);
+
+    static void copyName(char (&destination)[24], std::string const &name);
+
+};
+
+
+/**
+ * Read-only view of a state file, mapped into memory
+ * Only the pages of the columns that are actually read are loaded from disk
+ */
+class StateFileView {
+public:
+
+    StateFileView() = default;
+
+    explicit StateFileView(std::string const &filename) {
+        open(filename);
+    }
+
+    /**
+     * Maps a state file, replacing the current one, along with its keyframe if it is a delta frame
+     * The keyframe stays mapped while the following frames refer to it, so stepping through them is cheap
+     * Fails if the file is missing, is not a state file of a supported version, or is truncated
+     */
+    bool open(std::string const &filename) {
+        return open(filename, false);
+    }
+
+    void close() {
+        file.close();
+        filename.clear();
+        keyframe.reset();
+    }
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    STATE_FILE_HEADER const &header() const {
+        return *reinterpret_cast<STATE_FILE_HEADER const *>(file.data());
+    }
+
+    size_t numParticles() const {
+        return header().numParticles;
+    }
+
+    STATE_FILE_PARAMETER const *parameters() const {
+        return reinterpret_cast<STATE_FILE_PARAMETER const *>(file.data() + header().tableOffset);
+    }
+
+    STATE_FILE_COLUMN const *columns() const {
+        return reinterpret_cast<STATE_FILE_COLUMN const *>(parameters() + header().numParameters);
+    }
+
+    double parameter(std::string const &name, double fallback = 0) const;
+
+    STATE_FILE_COLUMN const *column(std::string const &name) const;
+
+    /**
+     * Values of a column stored raw as T, in place in the mapping
+     * Returns nullptr if the column is missing or stored differently
+     */
+    template<typename T>
+    T const *columnValues(std::string const &name, uint32_t components) const {
+        auto c = column(name);
+        if (!c || c->type != StateFileTypeOf<T>::value || c->components != components ||
+            c->codec != STATE_FILE_CODEC_RAW) {
+            return nullptr;
+        }
+        return reinterpret_cast<T const *>(file.data() + c->offset);
+    }
+
+    /**
+     * Reads a column as T whatever its stored type and codec
+     * set(p, values) receives the values of particle p, it is called concurrently for different particles
+     * Returns false if the column is missing, has a different number of components or cannot be decoded
+     */
+    template<typename T, typename F>
+    bool readColumn(std::string const &name, uint32_t components, F const &set) const {
+        auto c = column(name);
+        if (!c || c->components != components || components > 16) return false;
+
+        std::vector<uint8_t> decoded;
+        auto stored = columnData(*c, decoded);
+        if (!stored) return false;
+
+        if ((c->codec & ~STATE_FILE_CODEC_DELTA) == STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4) {
+            auto quantization = c->quantization;
+            readValues<uint16_t, T>(reinterpret_cast<uint16_t const *>(stored), components,
+                                    [&set, quantization](size_t p, T *values, uint32_t components) {
+                                        for (auto i = 0; i < components; i++) values[i] *= quantization;
+                                        set(p, values);
+                                    });
+            return true;
+        }
+
+        auto forward = [&set](size_t p, T *values, uint32_t) {
+            set(p, values);
+        };
+
+        switch (c->type) {
+            case STATE_FILE_FLOAT32:
+                readValues<float, T>(reinterpret_cast<float const *>(stored), components, forward);
+                return true;
+            case STATE_FILE_FLOAT64:
+                readValues<double, T>(reinterpret_cast<double const *>(stored), components, forward);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+private:
+
+    MappedFile file;
+
+    std::string filename;
+    std::unique_ptr<StateFileView> keyframe;
+
+    // Decoded columns, kept while this is the keyframe of the frames being read
+    mutable std::map<std::string, std::vector<uint8_t>> keyframeColumns;
+
+    /**
+     * Keyframes must not be delta frames themselves
+     */
+    bool open(std::string const &filename, bool isKeyframe);
+
+    /**
+     * Values of a column as passed to its codec, decoded into scratch unless they are stored raw
+     * Returns nullptr if they cannot be decoded
+     */
+    uint8_t const *columnData(STATE_FILE_COLUMN const &column, std::vector<uint8_t> &scratch) const;
+
+    uint8_t const *keyframeColumnData(STATE_FILE_COLUMN const &column) const;
+
+    template<typename S, typename T, typename F>
+    void readValues(S const *stored, uint32_t components, F const &set) const {
+        auto n = numParticles();
+
+#pragma omp parallel for
+        for (auto p = 0; p < n; p++) {
+            T values[16];
+            for (auto i = 0; i < components; i++) {
+                values[i] = static_cast<T>(stored[p * components + i]);
+            }
+            set(p, values, components);
+        }
+    }
+
+};
+
+
+#endif //SNOW_STATEFILE_H
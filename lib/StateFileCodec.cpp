@@ -0,0 +1,243 @@
+#include "StateFileCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+void shuffleBytes(uint8_t const *in, uint8_t *out, size_t count, size_t elementSize) {
+#pragma omp parallel for
+    for (auto b = 0; b < elementSize; b++) {
+        auto plane = out + b * count;
+        for (size_t i = 0; i < count; i++) {
+            plane[i] = in[i * elementSize + b];
+        }
+    }
+}
+
+void unshuffleBytes(uint8_t const *in, uint8_t *out, size_t count, size_t elementSize) {
+#pragma omp parallel for
+    for (auto b = 0; b < elementSize; b++) {
+        auto plane = in + b * count;
+        for (size_t i = 0; i < count; i++) {
+            out[i * elementSize + b] = plane[i];
+        }
+    }
+}
+
+// LZ4 block format limits: the last 5 bytes are always literals, and no match starts in the last 12 bytes
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 14
+
+static inline uint32_t read32(uint8_t const *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lz4Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static inline uint8_t *writeLength(uint8_t *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+static inline uint8_t *writeSequence(uint8_t *op, uint8_t const *literals, size_t numLiterals, size_t offset,
+                                     size_t matchLength) {
+    auto token = op++;
+    *token = static_cast<uint8_t>((numLiterals < 15 ? numLiterals : 15) << 4);
+    if (numLiterals >= 15) op = writeLength(op, numLiterals - 15);
+    memcpy(op, literals, numLiterals);
+    op += numLiterals;
+
+    if (matchLength == 0) return op; // Last sequence, literals only
+
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+
+    auto extraMatchLength = matchLength - LZ4_MIN_MATCH;
+    *token |= static_cast<uint8_t>(extraMatchLength < 15 ? extraMatchLength : 15);
+    if (extraMatchLength >= 15) op = writeLength(op, extraMatchLength - 15);
+
+    return op;
+}
+
+size_t lz4Compress(uint8_t const *in, size_t bytes, uint8_t *out) {
+    uint32_t table[1 << LZ4_HASH_BITS] = {}; // Positions + 1, 0 when empty
+
+    auto op = out;
+    size_t anchor = 0;
+
+    if (bytes > LZ4_MATCH_LIMIT) {
+        auto matchStartLimit = bytes - LZ4_MATCH_LIMIT;
+        auto matchEndLimit = bytes - LZ4_LAST_LITERALS;
+
+        size_t ip = 0;
+        while (ip < matchStartLimit) {
+            auto sequence = read32(in + ip);
+            auto h = lz4Hash(sequence);
+            auto candidate = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > LZ4_MAX_OFFSET || read32(in + candidate - 1) != sequence) {
+                ip++;
+                continue;
+            }
+
+            auto match = candidate - 1;
+            auto matchLength = static_cast<size_t>(LZ4_MIN_MATCH);
+            while (ip + matchLength < matchEndLimit && in[match + matchLength] == in[ip + matchLength]) {
+                matchLength++;
+            }
+
+            op = writeSequence(op, in + anchor, ip - anchor, ip - match, matchLength);
+            ip += matchLength;
+            anchor = ip;
+        }
+    }
+
+    op = writeSequence(op, in + anchor, bytes - anchor, 0, 0);
+
+    return static_cast<size_t>(op - out);
+}
+
+static inline bool readLength(uint8_t const *&ip, uint8_t const *inEnd, size_t &length) {
+    uint8_t byte;
+    do {
+        if (ip >= inEnd) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool lz4Decompress(uint8_t const *in, size_t bytes, uint8_t *out, size_t outBytes) {
+    auto ip = in;
+    auto inEnd = in + bytes;
+    auto op = out;
+    auto outEnd = out + outBytes;
+
+    while (ip < inEnd) {
+        auto token = *ip++;
+
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15 && !readLength(ip, inEnd, numLiterals)) return false;
+        if (numLiterals > static_cast<size_t>(inEnd - ip) || numLiterals > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        memcpy(op, ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+
+        if (ip == inEnd) break; // Last sequence, literals only
+
+        if (inEnd - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - out)) return false;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, inEnd, matchLength)) return false;
+        matchLength += LZ4_MIN_MATCH;
+        if (matchLength > static_cast<size_t>(outEnd - op)) return false;
+
+        auto match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+            op += matchLength;
+        } else {
+            // Overlapping match repeats the last offset bytes
+            for (size_t i = 0; i < matchLength; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == outEnd;
+}
+
+size_t encodeColumn(uint8_t const *in, size_t count, size_t elementSize, std::vector<uint8_t> &out) {
+    auto bytes = count * elementSize;
+    auto numBlocks = (bytes + STATE_FILE_CODEC_BLOCK_BYTES - 1) / STATE_FILE_CODEC_BLOCK_BYTES;
+
+    std::vector<uint8_t> shuffled(bytes);
+    shuffleBytes(in, shuffled.data(), count, elementSize);
+
+    // Compress every block into its own slot first, then pack them back to back
+    std::vector<uint8_t> blocks(numBlocks * lz4CompressBound(STATE_FILE_CODEC_BLOCK_BYTES));
+    std::vector<uint32_t> blockSizes(numBlocks);
+
+#pragma omp parallel for
+    for (auto b = 0; b < numBlocks; b++) {
+        auto begin = b * static_cast<size_t>(STATE_FILE_CODEC_BLOCK_BYTES);
+        auto blockBytes = std::min(static_cast<size_t>(STATE_FILE_CODEC_BLOCK_BYTES), bytes - begin);
+        blockSizes[b] = static_cast<uint32_t>(lz4Compress(shuffled.data() + begin, blockBytes,
+                                                          blocks.data() +
+                                                          b * lz4CompressBound(STATE_FILE_CODEC_BLOCK_BYTES)));
+    }
+
+    auto headerBytes = (2 + numBlocks) * sizeof(uint32_t);
+    size_t encodedBytes = headerBytes;
+    for (auto blockSize : blockSizes) encodedBytes += blockSize;
+    out.resize(encodedBytes);
+
+    uint32_t header[2] = {static_cast<uint32_t>(numBlocks), STATE_FILE_CODEC_BLOCK_BYTES};
+    memcpy(out.data(), header, sizeof(header));
+    memcpy(out.data() + sizeof(header), blockSizes.data(), numBlocks * sizeof(uint32_t));
+
+    auto op = out.data() + headerBytes;
+    for (auto b = 0; b < numBlocks; b++) {
+        memcpy(op, blocks.data() + b * lz4CompressBound(STATE_FILE_CODEC_BLOCK_BYTES), blockSizes[b]);
+        op += blockSizes[b];
+    }
+
+    return encodedBytes;
+}
+
+bool decodeColumn(uint8_t const *in, size_t bytes, size_t count, size_t elementSize, uint8_t *out) {
+    auto decodedBytes = count * elementSize;
+
+    uint32_t header[2];
+    if (bytes < sizeof(header)) return false;
+    memcpy(header, in, sizeof(header));
+    auto numBlocks = static_cast<size_t>(header[0]);
+    auto blockBytes = static_cast<size_t>(header[1]);
+
+    if (blockBytes == 0 || numBlocks != (decodedBytes + blockBytes - 1) / blockBytes ||
+        bytes < (2 + numBlocks) * sizeof(uint32_t)) {
+        return false;
+    }
+
+    // Block offsets from their sizes
+    std::vector<size_t> blockOffsets(numBlocks + 1);
+    blockOffsets[0] = (2 + numBlocks) * sizeof(uint32_t);
+    for (size_t b = 0; b < numBlocks; b++) {
+        uint32_t blockSize;
+        memcpy(&blockSize, in + sizeof(header) + b * sizeof(uint32_t), sizeof(blockSize));
+        blockOffsets[b + 1] = blockOffsets[b] + blockSize;
+    }
+    if (blockOffsets[numBlocks] > bytes) return false;
+
+    std::vector<uint8_t> shuffled(decodedBytes);
+    auto valid = true;
+
+#pragma omp parallel for reduction(&&:valid)
+    for (auto b = 0; b < numBlocks; b++) {
+        auto begin = b * blockBytes;
+        valid = lz4Decompress(in + blockOffsets[b], blockOffsets[b + 1] - blockOffsets[b],
+                              shuffled.data() + begin, std::min(blockBytes, decodedBytes - begin)) && valid;
+    }
+    if (!valid) return false;
+
+    unshuffleBytes(shuffled.data(), out, count, elementSize);
+
+    return true;
+}
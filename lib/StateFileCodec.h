@@ -0,0 +1,61 @@
+#ifndef SNOW_STATEFILECODEC_H
+#define SNOW_STATEFILECODEC_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * Column codecs for state files
+ *
+ * Encoded columns are byte-shuffled (all first bytes of every value, then all second bytes, ...) so that the
+ * slowly varying high bytes of floating point values line up, then split into blocks that are compressed
+ * independently with the LZ4 block format, so blocks can be encoded and decoded in parallel.
+ *
+ * Encoded column
+ *   uint32_t numBlocks
+ *   uint32_t blockBytes; // Decoded bytes per block, the last one may be shorter
+ *   uint32_t encodedBlockBytes[numBlocks];
+ *   Blocks, back to back
+ */
+
+#define STATE_FILE_CODEC_BLOCK_BYTES (1 << 20)
+
+/**
+ * Shuffles count elements of elementSize bytes
+ */
+void shuffleBytes(uint8_t const *in, uint8_t *out, size_t count, size_t elementSize);
+
+void unshuffleBytes(uint8_t const *in, uint8_t *out, size_t count, size_t elementSize);
+
+/**
+ * Largest possible LZ4 block for an input of the given size
+ */
+inline size_t lz4CompressBound(size_t bytes) {
+    return bytes + bytes / 255 + 16;
+}
+
+/**
+ * Compresses into an LZ4 block, out must hold lz4CompressBound(bytes), returns the compressed size
+ */
+size_t lz4Compress(uint8_t const *in, size_t bytes, uint8_t *out);
+
+/**
+ * Decompresses an LZ4 block of exactly outBytes, returns false on malformed input
+ */
+bool lz4Decompress(uint8_t const *in, size_t bytes, uint8_t *out, size_t outBytes);
+
+/**
+ * Shuffles and compresses count elements of elementSize bytes, returns the encoded size
+ */
+size_t encodeColumn(uint8_t const *in, size_t count, size_t elementSize, std::vector<uint8_t> &out);
+
+/**
+ * Reverses encodeColumn, out must hold count elements of elementSize bytes
+ */
+bool decodeColumn(uint8_t const *in, size_t bytes, size_t count, size_t elementSize, uint8_t *out);
+
+
+#endif //SNOW_STATEFILECODEC_H
@@ -0,0 +1,42 @@
+#include "Trace.h"
+
+#include <iomanip>
+
+
+bool TraceSink::open(std::string const &filename) {
+    close();
+
+    file.open(filename, std::ofstream::trunc);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    file << std::fixed << std::setprecision(3);
+
+    origin = clock::now();
+    numEvents = 0;
+    threads.clear();
+
+    return static_cast<bool>(file);
+}
+
+void TraceSink::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+
+    file << "\n]}\n";
+    file.close();
+}
+
+void TraceSink::complete(char const *name, char const *category, clock::time_point start, clock::time_point end,
+                         char const *argumentName, double argumentValue) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!file.is_open()) return;
+
+    // Small consecutive thread ids, in order of appearance
+    auto thread = threads.emplace(std::this_thread::get_id(), threads.size()).first->second;
+
+    file << (numEvents++ ? ",\n" : "\n")
+         << "{\"name\": \"" << name << "\", \"cat\": \"" << category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+         << thread << ", \"ts\": " << std::chrono::duration<double, std::micro>(start - origin).count()
+         << ", \"dur\": " << std::chrono::duration<double, std::micro>(end - start).count();
+    if (argumentName) file << ", \"args\": {\"" << argumentName << "\": " << argumentValue << "}";
+    file << "}";
+}
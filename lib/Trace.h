@@ -0,0 +1,59 @@
+#ifndef SNOW_TRACE_H
+#define SNOW_TRACE_H
+
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/**
+ * Timeline of a run as a Chrome trace (chrome://tracing, ui.perfetto.dev)
+ * Events are streamed to the file as they end, from any thread, each thread getting its own track
+ */
+class TraceSink {
+public:
+
+    typedef std::chrono::steady_clock clock;
+
+    TraceSink() = default;
+
+    TraceSink(TraceSink const &) = delete;
+
+    TraceSink &operator=(TraceSink const &) = delete;
+
+    ~TraceSink() {
+        close();
+    }
+
+    bool open(std::string const &filename);
+
+    void close();
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    /**
+     * Records a span, with an optional numeric argument shown along with it
+     * Names must be plain identifiers, they are written without escaping
+     */
+    void complete(char const *name, char const *category, clock::time_point start, clock::time_point end,
+                  char const *argumentName = nullptr, double argumentValue = 0);
+
+private:
+
+    std::ofstream file;
+    clock::time_point origin;
+    size_t numEvents = 0;
+
+    std::mutex mutex;
+    std::map<std::thread::id, unsigned int> threads;
+
+};
+
+
+#endif //SNOW_TRACE_H
@@ -2,6 +2,8 @@
 #define SNOW_CONJUGATERESIDUALSOLVER_H
 
 
+#include <cfloat>
+#include <cmath>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -76,12 +78,13 @@ inline std::vector<V> operator-(std::vector<V> const &a, std::vector<V> const &b
  * Solves Ax = b
  * The initial guess is passed in as x
  * The result will be written in x
+ * Returns the number of iterations run
  */
 template<typename V>
-inline void conjugateResidualSolver(void (*A)(std::vector<V> &Ax, std::vector<V> const &x),
-                                    std::vector<V> &x,
-                                    std::vector<V> const &b,
-                                    int k) {
+inline int conjugateResidualSolver(void (*A)(std::vector<V> &Ax, std::vector<V> const &x),
+                                   std::vector<V> &x,
+                                   std::vector<V> const &b,
+                                   int k) {
     std::vector<V> Ax(b.size());
 
     // Ax_0
@@ -100,16 +103,20 @@ inline void conjugateResidualSolver(void (*A)(std::vector<V> &Ax, std::vector<V>
     std::vector<V> Ap(b.size());
     A(Ap, p);
 
+    auto iterations = 0;
+
     while (k-- > 0 && r * r >= FLT_EPSILON) {
         LOG(VERBOSE) << "Solving k=" << k << std::endl;
 
+        iterations++;
+
         // r_k^T Ar_k
         auto dot_r_Ar_k = dot_r_Ar;
 
         // a_k
         auto a = dot_r_Ar_k / (Ap * Ap);
 
-        if (abs(a) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
+        if (std::abs(a) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
 
         // x_k+1
         x = x + a * p;
@@ -125,7 +132,7 @@ inline void conjugateResidualSolver(void (*A)(std::vector<V> &Ax, std::vector<V>
         // b_k
         auto beta = dot_r_Ar / dot_r_Ar_k;
 
-        if (abs(beta) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
+        if (std::abs(beta) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
 
         // p_k+1
         p = r + beta * p;
@@ -141,19 +148,22 @@ inline void conjugateResidualSolver(void (*A)(std::vector<V> &Ax, std::vector<V>
         LOG(VERBOSE) << "Didn't converge" << std::endl;
     }
 
+    return iterations;
+
 }
 
 /**
  * Solves Ax = b
  * The initial guess is passed in as x
  * The result will be written in x
+ * Returns the number of iterations run
  */
 template<typename C, typename V>
-inline void conjugateResidualSolver(C *instance,
-                                    void (C::*A)(std::vector<V> &Ax, std::vector<V> const &x),
-                                    std::vector<V> &x,
-                                    std::vector<V> const &b,
-                                    int k) {
+inline int conjugateResidualSolver(C *instance,
+                                   void (C::*A)(std::vector<V> &Ax, std::vector<V> const &x),
+                                   std::vector<V> &x,
+                                   std::vector<V> const &b,
+                                   int k) {
     std::vector<V> Ax(b.size());
 
     // Ax_0
@@ -172,16 +182,20 @@ inline void conjugateResidualSolver(C *instance,
     std::vector<V> Ap(b.size());
     (instance->*A)(Ap, p);
 
+    auto iterations = 0;
+
     while (k-- > 0 && r * r >= FLT_EPSILON) {
         LOG(VERBOSE) << "Solving k=" << k << std::endl;
 
+        iterations++;
+
         // r_k^T Ar_k
         auto dot_r_Ar_k = dot_r_Ar;
 
         // a_k
         auto a = dot_r_Ar_k / (Ap * Ap);
 
-        if (abs(a) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
+        if (std::abs(a) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
 
         // x_k+1
         x = x + a * p;
@@ -197,7 +211,7 @@ inline void conjugateResidualSolver(C *instance,
         // b_k
         auto beta = dot_r_Ar / dot_r_Ar_k;
 
-        if (abs(beta) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
+        if (std::abs(beta) < FLT_EPSILON) break; // Non-standard: Break if insignificant increment
 
         // p_k+1
         p = r + beta * p;
@@ -213,6 +227,8 @@ inline void conjugateResidualSolver(C *instance,
         LOG(VERBOSE) << "Didn't converge" << std::endl;
     }
 
+    return iterations;
+
 }
 
 
@@ -0,0 +1,30 @@
+#ifndef SNOW_MEMORY_USAGE_H
+#define SNOW_MEMORY_USAGE_H
+
+
+#include <cstddef>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+
+/**
+ * Largest resident set of the process so far in bytes, 0 where it is not known
+ */
+inline size_t peakResidentSetSize() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // Bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // Kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+
+#endif //SNOW_MEMORY_USAGE_H
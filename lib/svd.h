@@ -0,0 +1,47 @@
+#ifndef SNOW_SVD_H
+#define SNOW_SVD_H
+
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <Dense>
+
+
+typedef Eigen::Matrix<double, 3, 3> eigen_matrix3;
+typedef Eigen::Matrix<double, 3, 1> eigen_vector3;
+
+
+// 3x3 decompositions of the deformation gradients, shared by the solvers
+
+inline void svd(glm::dmat3 const &m, glm::dmat3 &u, glm::dvec3 &e, glm::dmat3 &v) {
+    Eigen::Map<eigen_matrix3 const> mmap(glm::value_ptr(m));
+    Eigen::Map<eigen_matrix3> umap(glm::value_ptr(u));
+    Eigen::Map<eigen_vector3> emap(glm::value_ptr(e));
+    Eigen::Map<eigen_matrix3> vmap(glm::value_ptr(v));
+
+    Eigen::JacobiSVD<eigen_matrix3, Eigen::NoQRPreconditioner> svd;
+    svd.compute(mmap, Eigen::ComputeFullV | Eigen::ComputeFullU);
+    umap = svd.matrixU();
+    emap = svd.singularValues();
+    vmap = svd.matrixV();
+}
+
+inline glm::dmat3 polarRot(glm::dmat3 const &m) {
+    glm::dmat3 u;
+    glm::dvec3 e;
+    glm::dmat3 v;
+    svd(m, u, e, v);
+    return u * glm::transpose(v);
+}
+
+inline void polarDecompose(glm::dmat3 const &m, glm::dmat3 &r, glm::dmat3 &s) {
+    glm::dmat3 u;
+    glm::dvec3 e;
+    glm::dmat3 v;
+    svd(m, u, e, v);
+    r = u * glm::transpose(v);
+    s = v * glm::dmat3(e.x, 0, 0, 0, e.y, 0, 0, 0, e.z) * glm::transpose(v);
+}
+
+
+#endif //SNOW_SVD_H
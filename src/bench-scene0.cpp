@@ -0,0 +1,59 @@
+#include "utils/common.h"
+#include "utils/bench.h"
+#include "snow/sphere.h"
+#include "snow/slab.h"
+#include "scenes/scene0.h"
+
+
+/**
+ * Snowball of sim-gen-snowball dropped on the floor
+ */
+SceneBenchResult benchScene0Snowball(SceneBenchSettings const &settings) {
+    double density = 400; // kg/m3
+    double particleSize = sceneBenchParticleSize(.0072, settings);
+    double gridSize = particleSize * 2;
+
+    solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
+    solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
+
+    CounterRandom random(settings.seed);
+    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.03, density, particleSize, random);
+
+    auto result = runSceneBenchmark("snowball", *solver, settings);
+    solver.reset();
+    return result;
+}
+
+/**
+ * Snowman of sim-gen-snowman standing on a layer of snow, with the smaller time step of demo-snowman
+ */
+SceneBenchResult benchScene0Snowman(SceneBenchSettings const &settings) {
+    double density = 800; // kg/m3
+    double particleSize = sceneBenchParticleSize(.0072, settings);
+    double gridSize = particleSize * 2;
+
+    solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
+    solver->delta_t = 5e-4;
+    solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
+
+    auto r1 = 0.2 / 2;
+    auto r2 = 0.125 / 2;
+    auto r3 = 0.075 / 2;
+    auto overlap = 0.05;
+
+    auto c1 = 0.1 + r1;
+    auto c2 = c1 + r1 - overlap + r2;
+    auto c3 = c2 + r2 - overlap + r3;
+
+    CounterRandom random(settings.seed);
+    genSnowSlab(glm::dvec3(0.05, 0.05, 0.075), glm::dvec3(simulationSize.x - 0.05, simulationSize.y - 0.05, 0.125),
+                density, particleSize, random);
+
+    genSnowSphere(glm::dvec3(0.5, 0.5, c1), r1, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c2), r2, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c3), r3, density, particleSize, random);
+
+    auto result = runSceneBenchmark("snowman", *solver, settings);
+    solver.reset();
+    return result;
+}
@@ -0,0 +1,24 @@
+#include "utils/common.h"
+#include "utils/bench.h"
+#include "snow/slab.h"
+#include "scenes/scene1.h"
+
+
+/**
+ * Slab of sim-gen-slab falling over the wedge
+ */
+SceneBenchResult benchScene1SlabOverWedge(SceneBenchSettings const &settings) {
+    double density = 400; // kg/m3
+    double particleSize = sceneBenchParticleSize(.0072, settings);
+    double gridSize = particleSize * 2;
+
+    solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
+    solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
+
+    CounterRandom random(settings.seed);
+    genSnowSlab(glm::dvec3(0.2, 0.45, 0.7), glm::dvec3(0.8, 0.55, 0.9), density, particleSize, random);
+
+    auto result = runSceneBenchmark("slab-over-wedge", *solver, settings);
+    solver.reset();
+    return result;
+}
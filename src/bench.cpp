@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "utils/bench.h"
+#include "utils/common.h"
+
+
+SceneBenchResult benchScene0Snowball(SceneBenchSettings const &settings);
+
+SceneBenchResult benchScene0Snowman(SceneBenchSettings const &settings);
+
+SceneBenchResult benchScene1SlabOverWedge(SceneBenchSettings const &settings);
+
+SceneBenchResult lavaBenchScene2Floaty(SceneBenchSettings const &settings);
+
+
+struct SceneBenchMetric {
+    std::string scene;
+    std::string name;
+    double value;
+    int better; // 1 if higher is better, -1 if lower is, 0 if it is not compared
+};
+
+
+/**
+ * Metrics written to and compared against baselines, phases as their seconds per tick
+ */
+static std::vector<SceneBenchMetric> sceneBenchMetrics(SceneBenchResult const &result) {
+    std::vector<SceneBenchMetric> metrics = {
+            {result.scene, "particles",                 static_cast<double>(result.numParticles), 0},
+            {result.scene, "grid_nodes",                static_cast<double>(result.numGridNodes), 0},
+            {result.scene, "ticks",                     static_cast<double>(result.ticks),        0},
+            {result.scene, "seconds",                   result.seconds,                           0},
+            {result.scene, "ticks_per_second",          result.ticks / result.seconds,            1},
+            {result.scene, "particle_ticks_per_second", result.numParticles * result.ticks / result.seconds, 1},
+            {result.scene, "peak_rss_bytes",            static_cast<double>(result.peakRss),      -1},
+    };
+
+    for (auto const &phase : result.phases) {
+        metrics.push_back({result.scene, "phase:" + phase.name, phase.seconds / result.ticks, -1});
+    }
+
+    return metrics;
+}
+
+static void printSceneBenchResult(SceneBenchResult const &result) {
+    std::cout << "scene=" << result.scene << " particles=" << result.numParticles
+              << " grid_nodes=" << result.numGridNodes << " ticks=" << result.ticks << " seconds=" << result.seconds
+              << " ticks/s=" << result.ticks / result.seconds
+              << " particle-ticks/s=" << result.numParticles * result.ticks / result.seconds
+              << " peak_rss=" << result.peakRss / (1024 * 1024) << "MiB" << std::endl;
+
+    for (auto const &phase : result.phases) {
+        std::cout << "  " << std::left << std::setw(16) << phase.name << std::right
+                  << std::setw(12) << phase.seconds / result.ticks * 1000 << " ms/tick"
+                  << std::setw(8) << std::fixed << std::setprecision(1) << 100 * phase.seconds / result.seconds
+                  << "%" << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+/**
+ * Thread counts of a scaling run, the powers of two below the maximum and the maximum itself
+ */
+static std::vector<int> scalingThreadCounts(int maxThreads) {
+    std::vector<int> threads;
+    for (auto t = 1; t < maxThreads; t *= 2) threads.push_back(t);
+    threads.push_back(maxThreads);
+    return threads;
+}
+
+/**
+ * Seconds per tick of a phase, or of the whole tick without a phase name
+ */
+static double secondsPerTick(SceneBenchResult const &result, std::string const &phase) {
+    if (phase.empty()) return result.seconds / result.ticks;
+    for (auto const &p : result.phases) {
+        if (p.name == phase) return p.seconds / result.ticks;
+    }
+    return 0;
+}
+
+/**
+ * Efficiency relative to a single thread, the speedup per thread when scaling strongly, and the time per tick of a
+ * single thread over the time per tick with proportionally more work when scaling weakly
+ */
+static double scalingEfficiency(double seconds1, double seconds, int threads, bool isWeak) {
+    if (seconds <= 0) return 0;
+    return isWeak ? seconds1 / seconds : seconds1 / (threads * seconds);
+}
+
+/**
+ * Runs the scenes on 1 to maxThreads threads, with the same scene (strong) or with the particles and the grid nodes
+ * growing with the threads (weak), and prints the time per tick and the efficiency of every phase
+ */
+static void runScaling(std::vector<std::string> const &selected,
+                       std::map<std::string, SceneBenchResult (*)(SceneBenchSettings const &settings)> &scenes,
+                       SceneBenchSettings const &settings, bool isWeak, int maxThreads, std::string const &output) {
+#ifdef _OPENMP
+    auto threads = scalingThreadCounts(maxThreads);
+
+    std::ofstream file;
+    if (!output.empty()) {
+        file.open(output, std::ofstream::trunc);
+        file << "scene,scaling,threads,particles,grid_nodes,phase,seconds_per_tick,efficiency\n";
+    }
+
+    for (auto const &scene : selected) {
+        std::vector<SceneBenchResult> results;
+
+        for (auto t : threads) {
+            auto threadSettings = settings;
+            if (isWeak) threadSettings.resolution *= t;
+
+            omp_set_num_threads(t);
+            results.push_back(scenes[scene](threadSettings));
+        }
+
+        // Phases in the order they first ran, the whole tick first
+
+        std::vector<std::string> phases = {""};
+        for (auto const &result : results) {
+            for (auto const &phase : result.phases) {
+                if (std::find(phases.begin(), phases.end(), phase.name) == phases.end()) phases.push_back(phase.name);
+            }
+        }
+
+        std::cout << "scene=" << scene << " scaling=" << (isWeak ? "weak" : "strong") << " ticks=" << settings.ticks
+                  << std::endl;
+
+        std::cout << "  " << std::left << std::setw(16) << "threads" << std::right;
+        for (auto i = 0; i < threads.size(); i++) std::cout << std::setw(20) << threads[i];
+        std::cout << std::endl;
+
+        std::cout << "  " << std::left << std::setw(16) << "particles" << std::right;
+        for (auto const &result : results) std::cout << std::setw(20) << result.numParticles;
+        std::cout << std::endl;
+
+        for (auto const &phase : phases) {
+            std::cout << "  " << std::left << std::setw(16) << (phase.empty() ? "tick" : phase) << std::right
+                      << std::fixed;
+
+            auto seconds1 = secondsPerTick(results[0], phase);
+            for (auto i = 0; i < threads.size(); i++) {
+                auto seconds = secondsPerTick(results[i], phase);
+                auto efficiency = scalingEfficiency(seconds1, seconds, threads[i], isWeak);
+
+                std::cout << std::setprecision(3) << std::setw(11) << seconds * 1000 << "ms"
+                          << std::setprecision(0) << std::setw(6) << 100 * efficiency << "%";
+
+                if (file.is_open()) {
+                    file << scene << "," << (isWeak ? "weak" : "strong") << "," << threads[i] << ","
+                         << results[i].numParticles << "," << results[i].numGridNodes << ","
+                         << (phase.empty() ? "tick" : phase) << "," << seconds << "," << efficiency << "\n";
+                }
+            }
+
+            std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+        }
+    }
+
+    omp_set_num_threads(maxThreads);
+
+    if (file.is_open() && !file) {
+        std::cout << "Unable to write results: " << output << std::endl;
+        exit(1);
+    }
+#else
+    std::cout << "Scaling needs OpenMP, the solvers run on a single thread" << std::endl;
+    exit(1);
+#endif
+}
+
+/**
+ * Baselines are the CSV the launcher writes with --output, scene,metric,value
+ * scenes are listed in the order they ran
+ */
+static bool readBaseline(std::string const &filename, std::map<std::pair<std::string, std::string>, double> &baseline,
+                         std::vector<std::string> &scenes) {
+    std::ifstream file(filename);
+    if (!file) return false;
+
+    std::string line;
+    std::getline(file, line); // Header
+    while (std::getline(file, line)) {
+        std::stringstream ss(line);
+        std::string scene, name, value;
+        if (!std::getline(ss, scene, ',') || !std::getline(ss, name, ',') || !std::getline(ss, value)) continue;
+        baseline[std::make_pair(scene, name)] = std::stod(value);
+        if (std::find(scenes.begin(), scenes.end(), scene) == scenes.end()) scenes.push_back(scene);
+    }
+    return true;
+}
+
+void launchBench(int argc, char const **argv) {
+
+    std::map<std::string, SceneBenchResult (*)(SceneBenchSettings const &settings)> scenes;
+    scenes.insert(std::make_pair("snowball", benchScene0Snowball));
+    scenes.insert(std::make_pair("slab-over-wedge", benchScene1SlabOverWedge));
+    scenes.insert(std::make_pair("snowman", benchScene0Snowman));
+    scenes.insert(std::make_pair("floaty", lavaBenchScene2Floaty));
+
+    // Scenes in the order they are listed, all of them by default
+
+    std::vector<std::string> selected = {"snowball", "slab-over-wedge", "snowman", "floaty"};
+
+    if (argc > 2 && argv[2][0] != '-' && std::string(argv[2]) != "all") {
+        selected.clear();
+
+        std::stringstream ss(argv[2]);
+        std::string scene;
+        while (std::getline(ss, scene, ',')) {
+            if (scenes.find(scene) != scenes.end()) {
+                selected.push_back(scene);
+                continue;
+            }
+
+            std::cout << "Usage: ./snow bench [all|scene,...] [--ticks=n] [--seed=s] [--output=file.csv]"
+                      << " [--baseline=file.csv] [--threshold=t] [--scaling=strong|weak] [--threads=n]" << std::endl;
+
+            std::cout << "Scene " << scene << " not found, available scenes:" << std::endl;
+            for (auto const &it : scenes) {
+                std::cout << "  * " << it.first << std::endl;
+            }
+
+            exit(1);
+        }
+    }
+
+    SceneBenchSettings settings{10, 1, 1};
+
+    auto ticks = findOption(argc, argv, "ticks");
+    if (!ticks.empty()) settings.ticks = static_cast<unsigned int>(std::max(1, std::stoi(ticks)));
+
+    auto seed = findOption(argc, argv, "seed");
+    if (!seed.empty()) settings.seed = static_cast<unsigned int>(std::stoul(seed));
+
+    auto threshold = 0.1;
+    auto thresholdOption = findOption(argc, argv, "threshold");
+    if (!thresholdOption.empty()) threshold = std::stod(thresholdOption);
+
+    // Scaling over 1 to --threads threads, instead of a single run compared to a baseline
+
+    auto scaling = findOption(argc, argv, "scaling");
+    if (!scaling.empty()) {
+        if (scaling != "strong" && scaling != "weak") {
+            std::cout << "Unknown scaling: " << scaling << std::endl;
+            exit(1);
+        }
+
+#ifdef _OPENMP
+        auto maxThreads = omp_get_max_threads();
+#else
+        auto maxThreads = 1;
+#endif
+        auto threadsOption = findOption(argc, argv, "threads");
+        if (!threadsOption.empty()) maxThreads = std::max(1, std::stoi(threadsOption));
+
+        runScaling(selected, scenes, settings, scaling == "weak", maxThreads, findOption(argc, argv, "output"));
+        return;
+    }
+
+    std::map<std::pair<std::string, std::string>, double> baseline;
+    std::vector<std::string> baselineScenes;
+    auto baselineFilename = findOption(argc, argv, "baseline");
+    if (!baselineFilename.empty() && !readBaseline(baselineFilename, baseline, baselineScenes)) {
+        std::cout << "Unable to read baseline: " << baselineFilename << std::endl;
+        exit(1);
+    }
+
+    // Run, peak RSS is of the process so it only grows from scene to scene
+
+    std::vector<SceneBenchMetric> metrics;
+
+    for (auto const &scene : selected) {
+        auto result = scenes[scene](settings);
+        printSceneBenchResult(result);
+
+        auto sceneMetrics = sceneBenchMetrics(result);
+        metrics.insert(metrics.end(), sceneMetrics.begin(), sceneMetrics.end());
+    }
+
+    auto output = findOption(argc, argv, "output");
+    if (!output.empty()) {
+        std::ofstream file(output, std::ofstream::trunc);
+        file << "scene,metric,value\n" << std::setprecision(10);
+        for (auto const &metric : metrics) {
+            file << metric.scene << "," << metric.name << "," << metric.value << "\n";
+        }
+        if (!file) {
+            std::cout << "Unable to write results: " << output << std::endl;
+            exit(1);
+        }
+    }
+
+    if (baselineFilename.empty()) return;
+
+    // Regressions, only of scenes run with the same particles and ticks as the baseline
+
+    std::set<std::string> incomparable;
+
+    for (auto const &metric : metrics) {
+        if (metric.name != "particles" && metric.name != "ticks") continue;
+
+        auto it = baseline.find(std::make_pair(metric.scene, metric.name));
+        if (it == baseline.end() || it->second == metric.value) continue;
+
+        std::cout << "scene=" << metric.scene << " " << metric.name << "=" << metric.value
+                  << " differs from the baseline " << it->second << ", not compared" << std::endl;
+        incomparable.insert(metric.scene);
+    }
+
+    // Peak RSS is of the process, so a scene's also depends on the scenes that ran before it
+    auto comparePeakRss = selected == baselineScenes;
+    if (!comparePeakRss) {
+        std::cout << "Scenes differ from the baseline, peak_rss_bytes not compared" << std::endl;
+    }
+
+    auto regressions = 0;
+
+    for (auto const &metric : metrics) {
+        if (!metric.better || incomparable.count(metric.scene)) continue;
+        if (metric.name == "peak_rss_bytes" && !comparePeakRss) continue;
+
+        auto it = baseline.find(std::make_pair(metric.scene, metric.name));
+        if (it == baseline.end() || it->second <= 0) continue;
+        auto base = it->second;
+
+        auto change = metric.value / base - 1;
+        if (change * metric.better < -threshold) {
+            std::cout << "REGRESSION scene=" << metric.scene << " " << metric.name << "=" << metric.value
+                      << " baseline=" << base << " change=" << std::showpos << 100 * change << std::noshowpos << "%"
+                      << std::endl;
+            regressions++;
+        }
+    }
+
+    std::cout << regressions << " regression(s) beyond " << 100 * threshold << "% of " << baselineFilename
+              << std::endl;
+
+    if (regressions) exit(1);
+
+}
@@ -0,0 +1,12 @@
+#include "utils/convert.h"
+
+
+void launchConvert(int argc, char const **argv) {
+    if (argc < 7) {
+        std::cout << "Usage: ./snow convert in-dir out-dir start-frame end-frame state|positions|summary"
+                  << " [--threads=n] [--compress=lossless|lossy]" << std::endl;
+        exit(1);
+    }
+
+    startConvert(argc, argv);
+}
@@ -38,7 +38,8 @@ void launchDemoDiffSnowball(int argc, char const **argv) {
     ghostSolver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
     ghostSolver->beta = 1;
 
-    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.03, density, particleSize);
+    CounterRandom random; // Same particles on every run
+    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.03, density, particleSize, random);
 
     solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
     ghostSolver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
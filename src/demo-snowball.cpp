@@ -35,7 +35,8 @@ void launchDemoSnowball(int argc, char const **argv) {
     solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
     solver->delta_t = 5e-4;
 
-    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.06, density, particleSize);
+    CounterRandom random; // Same particles on every run
+    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.06, density, particleSize, random);
 
     solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
 
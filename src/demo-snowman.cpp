@@ -44,9 +44,10 @@ void launchDemoSnowman(int argc, char const **argv) {
     auto c2 = c1 + r1 - overlap + r2;
     auto c3 = c2 + r2 - overlap + r3;
 
-    genSnowSphere(glm::dvec3(0.5, 0.5, c1), r1, density, particleSize);
-    genSnowSphere(glm::dvec3(0.5, 0.5, c2), r2, density, particleSize);
-    genSnowSphere(glm::dvec3(0.5, 0.5, c3), r3, density, particleSize);
+    CounterRandom random; // Same particles on every run
+    genSnowSphere(glm::dvec3(0.5, 0.5, c1), r1, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c2), r2, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c3), r3, density, particleSize, random);
 
     solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
 
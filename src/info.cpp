@@ -1,12 +1,105 @@
+#include <sys/stat.h>
+
+#include "../lib/FrameIndex.h"
 #include "utils/common.h"
 
 
+static char const *stateFileTypeName(uint32_t type) {
+    switch (type) {
+        case STATE_FILE_FLOAT32:
+            return "float32";
+        case STATE_FILE_FLOAT64:
+            return "float64";
+        default:
+            return "unknown";
+    }
+}
+
+static char const *stateFileCodecName(uint32_t codec) {
+    switch (codec) {
+        case STATE_FILE_CODEC_RAW:
+            return "raw";
+        case STATE_FILE_CODEC_SHUFFLE_LZ4:
+            return "shuffle+lz4";
+        case STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4:
+            return "quantized16+shuffle+lz4";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Prints the header and tables only, particle columns are not read
+ */
+static void printStateFileInfo(StateFileView const &state) {
+    auto const &header = state.header();
+
+    std::cout << std::endl << "State file" << std::endl
+              << "Version = " << header.version << std::endl
+              << "Solver = " << (header.solver == STATE_FILE_SOLVER_LAVA ? "lava" : "snow") << std::endl
+              << std::endl << "Parameters" << std::endl;
+    for (auto i = 0; i < header.numParameters; i++) {
+        std::cout << state.parameters()[i].name << " = " << state.parameters()[i].value << std::endl;
+    }
+    std::cout << "Time = " << state.parameter("time", state.parameter("tick") * state.parameter("delta_t")) << std::endl;
+
+    std::cout << std::endl << "Particles" << std::endl
+              << "#particles = " << header.numParticles << std::endl
+              << std::endl << "Columns" << std::endl;
+    for (auto i = 0; i < header.numColumns; i++) {
+        auto const &column = state.columns()[i];
+        std::cout << column.name << " = " << stateFileTypeName(column.type) << " x" << column.components
+                  << ", " << stateFileCodecName(column.codec & ~STATE_FILE_CODEC_DELTA)
+                  << (column.codec & STATE_FILE_CODEC_DELTA ? " delta" : "") << ", " << column.bytes << " bytes"
+                  << std::endl;
+    }
+
+    std::cout << std::endl;
+}
+
+/**
+ * Prints one line per frame from the index of a run directory
+ */
+static void printFrameIndexInfo(FrameIndexView const &index) {
+    std::cout << "Solver = " << (index.header().solver == STATE_FILE_SOLVER_LAVA ? "lava" : "snow") << std::endl
+              << "#records = " << index.numRecords() << std::endl
+              << std::endl
+              << "frame,checkpoint,tick,ticks,time,particles,bytes,min_x,min_y,min_z,max_x,max_y,max_z,kinetic_energy"
+              << std::endl;
+    for (auto i = 0; i < index.numRecords(); i++) {
+        auto const &record = index.records()[i];
+        std::cout << record.frame << "," << (record.flags & FRAME_INDEX_CHECKPOINT ? 1 : 0) << "," << record.tick
+                  << "," << record.ticks << "," << record.time << "," << record.numParticles << "," << record.bytes;
+        for (auto bound : record.boundsMin) std::cout << "," << bound;
+        for (auto bound : record.boundsMax) std::cout << "," << bound;
+        std::cout << "," << record.kineticEnergy << std::endl;
+    }
+}
+
 void launchInfo(int argc, char const **argv) {
     if (argc < 3) {
-        std::cout << "Usage: ./snow info snowstate" << std::endl;
+        std::cout << "Usage: ./snow info snowstate|run-dir" << std::endl;
         exit(1);
     }
 
+    struct stat pathStat{};
+    if (stat(argv[2], &pathStat) == 0 && S_ISDIR(pathStat.st_mode)) {
+        FrameIndexView index(joinPath(argv[2], FRAME_INDEX_FILENAME));
+        if (!index.isOpen()) {
+            std::cout << "No frame index in: " << argv[2] << std::endl;
+            exit(1);
+        }
+        printFrameIndexInfo(index);
+        return;
+    }
+
+    StateFileView state(argv[2]);
+    if (state.isOpen()) {
+        printStateFileInfo(state);
+        return;
+    }
+
+    // Frames written before StateFile
     SnowSolver snowSolver{argv[2]};
 
     std::cout << std::endl << "Physical parameters" << std::endl
@@ -25,6 +118,6 @@ void launchInfo(int argc, char const **argv) {
               << std::endl << "Time" << std::endl
               << "Tick = " << snowSolver.tick << std::endl
               << "Time step = " << snowSolver.delta_t << std::endl
-              << "Time = " << snowSolver.tick * snowSolver.delta_t << std::endl
+              << "Time = " << snowSolver.getTime() << std::endl
               << std::endl;
 }
@@ -0,0 +1,46 @@
+#define SOLVER LavaSolver
+#define SOLVER_LAVA
+
+#include "utils/common.h"
+#include "utils/bench.h"
+#include "snow/sphere.h"
+#include "snow/slab.h"
+#include "scenes/scene2.h"
+
+
+/**
+ * Spheres of lava-sim-scene2-gen-floaty dropped into water, with the smaller time step of lava:demo-floaty
+ */
+SceneBenchResult lavaBenchScene2Floaty(SceneBenchSettings const &settings) {
+    double density = 1000; // kg/m3
+    double particleSize = sceneBenchParticleSize(.005, settings);
+    double gridSize = particleSize * 2;
+
+    solver.reset(new LavaSolver(gridSize, simulationSize * (1 / gridSize)));
+    solver->delta_t = 5e-4;
+    solver->isNodeColliding = isNodeColliding;
+    solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
+
+    CounterRandom random(settings.seed);
+    genSnowSlab(glm::dvec3(simulationReservedBoundary),
+                glm::dvec3(simulationSize.x - simulationReservedBoundary,
+                           simulationSize.y - simulationReservedBoundary,
+                           simulationSize.z * 0.2),
+                density, particleSize, random);
+    for (auto &particleNode : solver->particleNodes) {
+        particleNode.temperature = 10; // Low temperature water
+    }
+
+    genSnowSphere(glm::dvec3(simulationSize.x / 2 - 0.01, simulationSize.y / 2, simulationSize.z * 0.275),
+                  0.03, density, particleSize, random);
+    genSnowSphere(glm::dvec3(simulationSize.x / 2 + 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 0.125)),
+                  0.03, density, particleSize, random);
+    genSnowSphere(glm::dvec3(simulationSize.x / 2 - 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 2 * 0.125)),
+                  0.03, density, particleSize, random);
+    genSnowSphere(glm::dvec3(simulationSize.x / 2 + 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 3 * 0.125)),
+                  0.03, density, particleSize, random);
+
+    auto result = runSceneBenchmark("floaty", *solver, settings);
+    solver.reset();
+    return result;
+}
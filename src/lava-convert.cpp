@@ -0,0 +1,15 @@
+#define SOLVER LavaSolver
+#define SOLVER_LAVA
+
+#include "utils/convert.h"
+
+
+void lavaLaunchConvert(int argc, char const **argv) {
+    if (argc < 7) {
+        std::cout << "Usage: ./snow lava:convert in-dir out-dir start-frame end-frame state|positions|summary"
+                  << " [--threads=n] [--compress=lossless|lossy]" << std::endl;
+        exit(1);
+    }
+
+    startConvert(argc, argv);
+}
@@ -42,17 +42,18 @@ void lavaLaunchDemoFloaty(int argc, char const **argv) {
     solver->isNodeColliding = isNodeColliding;
     solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
 
+    CounterRandom random; // Same particles on every run
     genSnowSlab(glm::dvec3(simulationReservedBoundary),
                 glm::dvec3(simulationSize.x - simulationReservedBoundary,
                            simulationSize.y - simulationReservedBoundary,
                            simulationSize.z * 0.2),
-                density, particleSize);
+                density, particleSize, random);
     for (auto &particleNode : solver->particleNodes) {
         particleNode.temperature = 10; // Low temperature water
     }
 
     genSnowSphere(glm::dvec3(simulationSize.x / 2, simulationSize.y / 2, simulationSize.z * 3 / 4), 0.02, density,
-                  particleSize);
+                  particleSize, random);
 
     // Rendering
 
@@ -41,8 +41,9 @@ void lavaLaunchDemoSnowball(int argc, char const **argv) {
     solver->isNodeColliding = isNodeColliding;
     solver->handleNodeCollisionVelocityUpdate = handleNodeCollisionVelocityUpdate;
 
+    CounterRandom random; // Same particles on every run
     genSnowSphere(glm::dvec3(simulationSize.x / 2, simulationSize.y / 2, 0.06),
-                  0.025, density, particleSize);
+                  0.025, density, particleSize, random);
 
     // Rendering
 
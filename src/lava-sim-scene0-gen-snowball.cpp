@@ -21,14 +21,17 @@ void lavaLaunchSimScene0GenSnowball(int argc, char const **argv) {
 
     solver.reset(new LavaSolver(gridSize, simulationSize * (1 / gridSize)));
 
-    if (argc > 2) solver->delta_t = atof(argv[2]);
+    if (argc > 2 && argv[2][0] != '-') solver->delta_t = atof(argv[2]);
 
-    // Particles
+    // Particles, the same ones for the same seed
+
+    auto seed = findOption(argc, argv, "seed");
+    CounterRandom random(seed.empty() ? 0 : std::stoull(seed));
 
     genSnowSphere(glm::dvec3(simulationSize.x / 2, simulationSize.y / 2, simulationSize.z / 2),
-                  0.025, density, particleSize);
+                  0.025, density, particleSize, random);
 
-    std::cout << "#particles=" << solver->particleNodes.size() << std::endl;
+    std::cout << "#particles=" << solver->particleNodes.size() << " seed=" << (seed.empty() ? "0" : seed) << std::endl;
 
     // Output
 
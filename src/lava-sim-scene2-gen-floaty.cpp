@@ -22,29 +22,32 @@ void lavaLaunchSimScene2GenFloaty(int argc, char const **argv) {
 
     solver.reset(new LavaSolver(gridSize, simulationSize * (1 / gridSize)));
 
-    if (argc > 2) solver->delta_t = atof(argv[2]);
+    if (argc > 2 && argv[2][0] != '-') solver->delta_t = atof(argv[2]);
 
-    // Particles
+    // Particles, the same ones for the same seed
+
+    auto seed = findOption(argc, argv, "seed");
+    CounterRandom random(seed.empty() ? 0 : std::stoull(seed));
 
     genSnowSlab(glm::dvec3(simulationReservedBoundary),
                 glm::dvec3(simulationSize.x - simulationReservedBoundary,
                            simulationSize.y - simulationReservedBoundary,
                            simulationSize.z * 0.2),
-                density, particleSize);
+                density, particleSize, random);
     for (auto &particleNode : solver->particleNodes) {
         particleNode.temperature = 10; // Low temperature water
     }
 
     genSnowSphere(glm::dvec3(simulationSize.x / 2 - 0.01, simulationSize.y / 2, simulationSize.z * 0.275),
-                  0.03, density, particleSize);
+                  0.03, density, particleSize, random);
     genSnowSphere(glm::dvec3(simulationSize.x / 2 + 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 0.125)),
-                  0.03, density, particleSize);
+                  0.03, density, particleSize, random);
     genSnowSphere(glm::dvec3(simulationSize.x / 2 - 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 2 * 0.125)),
-                  0.03, density, particleSize);
+                  0.03, density, particleSize, random);
     genSnowSphere(glm::dvec3(simulationSize.x / 2 + 0.01, simulationSize.y / 2, simulationSize.z * (0.275 + 3 * 0.125)),
-                  0.03, density, particleSize);
+                  0.03, density, particleSize, random);
 
-    std::cout << "#particles=" << solver->particleNodes.size() << std::endl;
+    std::cout << "#particles=" << solver->particleNodes.size() << " seed=" << (seed.empty() ? "0" : seed) << std::endl;
 
     // Output
 
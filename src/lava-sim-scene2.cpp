@@ -7,7 +7,9 @@
 
 void lavaLaunchSimScene2(int argc, char const **argv) {
     if (argc < 4) {
-        std::cout << "Usage: ./snow lava:sim-scene2 start-frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow lava:sim-scene2 start-frame|latest end-frame"
+                  << " [--compress=lossless|lossy] [--keyframe-interval=n] [--checkpoint-interval=n] [--cfl=c]"
+                  << " [--profile=file.csv|file.json] [--perf-counters=1] [--trace=file.json]" << std::endl;
         exit(1);
     }
 
@@ -10,7 +10,7 @@
 
 void lavaLaunchVizScene2(int argc, char const **argv) {
     if (argc < 5) {
-        std::cout << "Usage: ./snow lava:viz-scene2 dir frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow lava:viz-scene2 dir frame end-frame [--prefetch-memory=mb]" << std::endl;
         exit(1);
     }
 
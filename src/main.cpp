@@ -4,6 +4,10 @@
 
 void launchInfo(int argc, char const **argv);
 
+void launchConvert(int argc, char const **argv);
+
+void launchBench(int argc, char const **argv);
+
 void launchDemoSnowball(int argc, char const **argv);
 
 void launchDemoDiffSnowball(int argc, char const **argv);
@@ -44,6 +48,8 @@ void lavaLaunchSimScene2(int argc, char const **argv);
 
 void lavaLaunchSimScene2GenFloaty(int argc, char const **argv);
 
+void lavaLaunchConvert(int argc, char const **argv);
+
 void lavaLaunchVizScene0(int argc, char const **argv);
 
 void lavaLaunchVizScene2(int argc, char const **argv);
@@ -55,6 +61,7 @@ int main(int argc, char const **argv) {
     std::map<std::string, void (*)(int argc, char const **argv)> routines;
 
     routines.insert(std::make_pair("info", launchInfo));
+    routines.insert(std::make_pair("bench", launchBench));
 
     // Snow solver
     routines.insert(std::make_pair("sim-gen-snowball", launchSimGenSnowball));
@@ -62,12 +69,14 @@ int main(int argc, char const **argv) {
     routines.insert(std::make_pair("sim-gen-snowman", launchSimGenSnowman));
     routines.insert(std::make_pair("sim-scene0", launchSimScene0));
     routines.insert(std::make_pair("sim-scene1", launchSimScene1));
+    routines.insert(std::make_pair("convert", launchConvert));
 
     // "Lava" solver
     routines.insert(std::make_pair("lava:sim-scene0", lavaLaunchSimScene0));
     routines.insert(std::make_pair("lava:sim-scene0-gen-snowball", lavaLaunchSimScene0GenSnowball));
     routines.insert(std::make_pair("lava:sim-scene2", lavaLaunchSimScene2));
     routines.insert(std::make_pair("lava:sim-scene2-gen-floaty", lavaLaunchSimScene2GenFloaty));
+    routines.insert(std::make_pair("lava:convert", lavaLaunchConvert));
 
 #if USE_RENDERBOX
 
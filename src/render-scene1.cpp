@@ -7,7 +7,7 @@
 
 void launchRenderScene1(int argc, char const **argv) {
     if (argc < 5) {
-        std::cout << "Usage: ./snow render-scene1 dir frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow render-scene1 dir frame end-frame [--prefetch-memory=mb]" << std::endl;
         exit(1);
     }
 
@@ -18,14 +18,17 @@ void launchSimGenSnowball(int argc, char const **argv) {
 
     solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
 
-    if (argc > 2) solver->delta_t = atof(argv[2]);
-    if (argc > 3) solver->beta = atof(argv[3]);
+    if (argc > 2 && argv[2][0] != '-') solver->delta_t = atof(argv[2]);
+    if (argc > 3 && argv[3][0] != '-') solver->beta = atof(argv[3]);
 
-    // Particles
+    // Particles, the same ones for the same seed
 
-    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.03, density, particleSize);
+    auto seed = findOption(argc, argv, "seed");
+    CounterRandom random(seed.empty() ? 0 : std::stoull(seed));
 
-    std::cout << "#particles=" << solver->particleNodes.size() << std::endl;
+    genSnowSphere(glm::dvec3(0.5, 0.5, 0.5), 0.03, density, particleSize, random);
+
+    std::cout << "#particles=" << solver->particleNodes.size() << " seed=" << (seed.empty() ? "0" : seed) << std::endl;
 
     // Output
 
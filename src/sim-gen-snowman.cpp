@@ -19,10 +19,13 @@ void launchSimGenSnowman(int argc, char const **argv) {
 
     solver.reset(new SnowSolver(gridSize, simulationSize * (1 / gridSize)));
 
-    if (argc > 2) solver->delta_t = atof(argv[2]);
-    if (argc > 3) solver->beta = atof(argv[3]);
+    if (argc > 2 && argv[2][0] != '-') solver->delta_t = atof(argv[2]);
+    if (argc > 3 && argv[3][0] != '-') solver->beta = atof(argv[3]);
 
-    // Particles
+    // Particles, the same ones for the same seed
+
+    auto seed = findOption(argc, argv, "seed");
+    CounterRandom random(seed.empty() ? 0 : std::stoull(seed));
 
     auto r1 = 0.2 / 2;
     auto r2 = 0.125 / 2;
@@ -34,13 +37,13 @@ void launchSimGenSnowman(int argc, char const **argv) {
     auto c3 = c2 + r2 - overlap + r3;
 
     genSnowSlab(glm::dvec3(0.05, 0.05, 0.075), glm::dvec3(simulationSize.x - 0.05, simulationSize.y - 0.05, 0.125),
-                density, particleSize);
+                density, particleSize, random);
 
-    genSnowSphere(glm::dvec3(0.5, 0.5, c1), r1, density, particleSize);
-    genSnowSphere(glm::dvec3(0.5, 0.5, c2), r2, density, particleSize);
-    genSnowSphere(glm::dvec3(0.5, 0.5, c3), r3, density, particleSize);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c1), r1, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c2), r2, density, particleSize, random);
+    genSnowSphere(glm::dvec3(0.5, 0.5, c3), r3, density, particleSize, random);
 
-    std::cout << "#particles=" << solver->particleNodes.size() << std::endl;
+    std::cout << "#particles=" << solver->particleNodes.size() << " seed=" << (seed.empty() ? "0" : seed) << std::endl;
 
     // Output
 
@@ -4,7 +4,9 @@
 
 void launchSimScene0(int argc, char const **argv) {
     if (argc < 4) {
-        std::cout << "Usage: ./snow sim-scene0 start-frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow sim-scene0 start-frame|latest end-frame"
+                  << " [--compress=lossless|lossy] [--keyframe-interval=n] [--checkpoint-interval=n] [--cfl=c]"
+                  << " [--profile=file.csv|file.json] [--perf-counters=1] [--trace=file.json]" << std::endl;
         exit(1);
     }
 
@@ -3,7 +3,11 @@
 #include "../utils/common.h"
 
 
-static void genSnowSlab(glm::dvec3 corner1, glm::dvec3 corner2, double density, double particleSize) {
+/**
+ * Particles at uniformly random positions in a box, the same ones for the same stream of random numbers
+ */
+static void genSnowSlab(glm::dvec3 corner1, glm::dvec3 corner2, double density, double particleSize,
+                        CounterRandom &random) {
     auto simulationSize = solver->h * glm::dvec3(solver->size);
 
     double volume = std::abs(corner2.x - corner1.x) *
@@ -16,9 +20,9 @@ static void genSnowSlab(glm::dvec3 corner1, glm::dvec3 corner2, double density,
 
     while (numParticles < totalNumParticles) {
         auto particlePosition = glm::dvec3(
-                randNumber(corner1.x, corner2.x),
-                randNumber(corner1.y, corner2.y),
-                randNumber(corner1.z, corner2.z));
+                random.uniform(corner1.x, corner2.x),
+                random.uniform(corner1.y, corner2.y),
+                random.uniform(corner1.z, corner2.z));
 
         solver->particleNodes.emplace_back(particlePosition, particleMass);
         if (ghostSolver) ghostSolver->particleNodes.emplace_back(particlePosition, particleMass);
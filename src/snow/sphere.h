@@ -3,7 +3,11 @@
 #include "../utils/common.h"
 
 
-static void genSnowSphere(glm::dvec3 position, double radius, double density, double particleSize) {
+/**
+ * Particles at uniformly random positions in a sphere, the same ones for the same stream of random numbers
+ */
+static void genSnowSphere(glm::dvec3 position, double radius, double density, double particleSize,
+                          CounterRandom &random) {
     auto simulationSize = solver->h * glm::dvec3(solver->size);
 
     double volume = 4.0 / 3 * M_PI * pow(radius, 3);
@@ -14,9 +18,9 @@ static void genSnowSphere(glm::dvec3 position, double radius, double density, do
 
     while (numParticles < totalNumParticles) {
         auto guess = glm::dvec3(
-                randNumber(position.x - radius, position.x + radius),
-                randNumber(position.y - radius, position.y + radius),
-                randNumber(position.z - radius, position.z + radius));
+                random.uniform(position.x - radius, position.x + radius),
+                random.uniform(position.y - radius, position.y + radius),
+                random.uniform(position.z - radius, position.z + radius));
 
         if (glm::length(guess - position) <= radius) {
 
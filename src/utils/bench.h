@@ -0,0 +1,77 @@
+#ifndef SNOW_BENCH_H
+#define SNOW_BENCH_H
+
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../lib/memory_usage.h"
+#include "../../lib/Profiler.h"
+
+
+struct SceneBenchSettings {
+    unsigned int ticks;
+    unsigned int seed; // Of the particle generators
+    double resolution; // Particles and grid nodes per volume, relative to the scene as generated
+};
+
+/**
+ * Particle size of a scene at the resolution of the settings
+ */
+inline double sceneBenchParticleSize(double particleSize, SceneBenchSettings const &settings) {
+    return particleSize / std::cbrt(settings.resolution);
+}
+
+struct SceneBenchResult {
+
+    struct Phase {
+        std::string name;
+        uint64_t calls;
+        double seconds;
+    };
+
+    std::string scene;
+    size_t numParticles;
+    size_t numGridNodes;
+    unsigned int ticks;
+    double seconds;
+    size_t peakRss; // Of the process so far, in bytes
+    std::vector<Phase> phases;
+
+};
+
+
+/**
+ * Runs a generated scene for a fixed number of ticks, timing every tick and its phases
+ */
+template<typename S>
+static SceneBenchResult runSceneBenchmark(char const *scene, S &solver, SceneBenchSettings const &settings) {
+    Profiler profiler;
+    solver.profiler = &profiler;
+
+    auto start = Profiler::clock::now();
+    for (auto tick = 0u; tick < settings.ticks; tick++) {
+        solver.update();
+    }
+    auto seconds = std::chrono::duration<double>(Profiler::clock::now() - start).count();
+
+    solver.profiler = nullptr;
+
+    SceneBenchResult result;
+    result.scene = scene;
+    result.numParticles = solver.particleNodes.size();
+    result.numGridNodes = static_cast<size_t>(solver.size.x) * solver.size.y * solver.size.z;
+    result.ticks = settings.ticks;
+    result.seconds = seconds;
+    result.peakRss = peakResidentSetSize();
+    for (auto const &phase : profiler.getPhases()) {
+        result.phases.push_back({phase.name, phase.calls, phase.seconds});
+    }
+    return result;
+}
+
+
+#endif //SNOW_BENCH_H
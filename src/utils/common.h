@@ -1,7 +1,10 @@
 #ifndef SNOW_COMMON_H
 #define SNOW_COMMON_H
 
+#include <cstdlib>
+#include <iostream>
 #include <memory>
+#include <string>
 
 #ifndef SOLVER
 #define SOLVER SnowSolver
@@ -14,6 +17,7 @@
 #define SOLVER_STATE_EXT ".snowstate"
 #endif
 
+#include "../../lib/CounterRandom.h"
 #include "../../lib/SnowSolver.h"
 #include "../../lib/LavaSolver.h"
 
@@ -23,13 +27,34 @@ static std::unique_ptr<SOLVER> solver;
 static std::unique_ptr<SOLVER> ghostSolver; // Alternative solver for diffing purposes
 
 
-inline double randNumber(double lo, double hi) {
-    return lo + rand() / (RAND_MAX / (hi - lo));
-}
-
 inline std::string joinPath(std::string a, std::string b) {
     return a + "/" + b;
 }
 
+/**
+ * Value of an optional --name=value argument, empty if it is not given
+ */
+inline std::string findOption(int argc, char const **argv, std::string const &name) {
+    auto prefix = "--" + name + "=";
+    for (auto i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, prefix.size(), prefix) == 0) return arg.substr(prefix.size());
+    }
+    return "";
+}
+
+/**
+ * Value of an optional --name=1|0 (or true|false) argument, fallback if it is not given, exits on any other value
+ */
+inline bool findFlag(int argc, char const **argv, std::string const &name, bool fallback = false) {
+    auto value = findOption(argc, argv, name);
+    if (value.empty()) return fallback;
+    if (value == "1" || value == "true") return true;
+    if (value == "0" || value == "false") return false;
+
+    std::cout << "Unknown value of --" << name << ": " << value << std::endl;
+    exit(1);
+}
+
 
 #endif //SNOW_COMMON_H
@@ -0,0 +1,278 @@
+#ifndef SNOW_CONVERT_H
+#define SNOW_CONVERT_H
+
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "common.h"
+#include "../../lib/FrameIndex.h"
+
+
+/**
+ * Output stage of the conversion, one instance is shared by every worker thread
+ * write is called concurrently for different frames, each worker passing its own solver and scratch buffer
+ */
+class ConvertOutput {
+public:
+
+    virtual ~ConvertOutput() = default;
+
+    /**
+     * fields are the particle columns the frame holds, empty if it holds all of them
+     * Returns false if the frame could not be written
+     */
+    virtual bool write(unsigned int frame, SOLVER &frameSolver, std::vector<std::string> const &fields,
+                       std::vector<char> &buffer) = 0;
+
+    /**
+     * Called once every frame has been written
+     */
+    virtual bool finish() {
+        return true;
+    }
+
+};
+
+
+static std::string convertOutputDir;
+static StateFileCompression convertCompression = STATE_FILE_UNCOMPRESSED;
+
+static std::string convertFilename(std::string const &dir, unsigned int frame, char const *ext) {
+    std::ostringstream filename;
+    filename << "frame-" << frame << ext;
+    return joinPath(dir, filename.str());
+}
+
+static bool writeFile(std::string const &filename, char const *data, size_t bytes) {
+    std::ofstream file;
+    file.open(filename, std::ofstream::binary | std::ofstream::trunc);
+    file.write(data, bytes);
+    file.close();
+    return static_cast<bool>(file);
+}
+
+/**
+ * Re-encodes frames as current state files, e.g. frames written before StateFile
+ * Only the columns of the source are packed, so viz frames stay viz frames instead of gaining zeroed columns
+ */
+class ConvertStateOutput : public ConvertOutput {
+public:
+
+    bool write(unsigned int frame, SOLVER &frameSolver, std::vector<std::string> const &fields,
+               std::vector<char> &buffer) override {
+        auto bytes = frameSolver.packState(buffer, convertCompression, nullptr, fields);
+        return writeFile(convertFilename(convertOutputDir, frame, SOLVER_STATE_EXT), buffer.data(), bytes);
+    }
+
+};
+
+/**
+ * Writes particle positions as binary little-endian PLY point clouds, read by most renderers
+ */
+class ConvertPositionsOutput : public ConvertOutput {
+public:
+
+    bool write(unsigned int frame, SOLVER &frameSolver, std::vector<std::string> const &fields,
+               std::vector<char> &buffer) override {
+        auto const &particleNodes = frameSolver.particleNodes;
+
+        std::ostringstream header;
+        header << "ply\n"
+               << "format binary_little_endian 1.0\n"
+               << "element vertex " << particleNodes.size() << "\n"
+               << "property float x\n"
+               << "property float y\n"
+               << "property float z\n"
+               << "end_header\n";
+        auto headerString = header.str();
+
+        buffer.resize(headerString.size() + particleNodes.size() * 3 * sizeof(float));
+        std::copy(headerString.begin(), headerString.end(), buffer.begin());
+
+        auto vertices = buffer.data() + headerString.size();
+
+#pragma omp parallel for
+        for (auto p = 0; p < particleNodes.size(); p++) {
+            float vertex[3] = {static_cast<float>(particleNodes[p].position.x),
+                               static_cast<float>(particleNodes[p].position.y),
+                               static_cast<float>(particleNodes[p].position.z)};
+            memcpy(vertices + p * sizeof(vertex), vertex, sizeof(vertex));
+        }
+
+        return writeFile(convertFilename(convertOutputDir, frame, ".ply"), buffer.data(), buffer.size());
+    }
+
+};
+
+/**
+ * Collects one CSV line of statistics per frame, written in frame order to summary.csv
+ */
+class ConvertSummaryOutput : public ConvertOutput {
+public:
+
+    bool write(unsigned int frame, SOLVER &frameSolver, std::vector<std::string> const &fields,
+               std::vector<char> &buffer) override {
+        FRAME_INDEX_RECORD record{};
+        computeFrameIndexStats(record, frameSolver.particleNodes);
+
+        std::ostringstream line;
+        line << frame << "," << frameSolver.getTick() << "," << frameSolver.getTime() << "," << record.numParticles;
+        for (auto bound : record.boundsMin) line << "," << bound;
+        for (auto bound : record.boundsMax) line << "," << bound;
+        line << "," << record.kineticEnergy << "\n";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        lines[frame] = line.str();
+        return true;
+    }
+
+    bool finish() override {
+        std::ofstream file(joinPath(convertOutputDir, "summary.csv"));
+        file << "frame,tick,time,particles,min_x,min_y,min_z,max_x,max_y,max_z,kinetic_energy\n";
+        for (auto const &line : lines) {
+            file << line.second;
+        }
+        file.close();
+        return static_cast<bool>(file);
+    }
+
+private:
+
+    std::mutex mutex;
+    std::map<unsigned int, std::string> lines;
+
+};
+
+
+/**
+ * Output stages by name, add new ones here
+ */
+static std::map<std::string, std::function<ConvertOutput *()>> convertOutputs = {
+        {"state",     [] { return new ConvertStateOutput(); }},
+        {"positions", [] { return new ConvertPositionsOutput(); }},
+        {"summary",   [] { return new ConvertSummaryOutput(); }}
+};
+
+
+/**
+ * Converts frames [start-frame, end-frame) of a run directory, every worker thread loading and writing whole frames
+ */
+static void startConvert(int argc, char const **argv) {
+
+    std::string inputDir = argv[2];
+    convertOutputDir = argv[3];
+    auto startFrame = static_cast<unsigned int>(std::stoi(argv[4]));
+    auto endFrame = static_cast<unsigned int>(std::stoi(argv[5]));
+
+    auto outputStage = convertOutputs.find(argv[6]);
+    if (outputStage == convertOutputs.end()) {
+        std::cout << "Unknown output: " << argv[6] << std::endl;
+        exit(1);
+    }
+    std::unique_ptr<ConvertOutput> output(outputStage->second());
+
+    auto compress = findOption(argc, argv, "compress");
+    if (compress == "lossless") {
+        convertCompression = STATE_FILE_LOSSLESS;
+    } else if (compress == "lossy") {
+        convertCompression = STATE_FILE_LOSSY;
+    } else if (!compress.empty()) {
+        std::cout << "Unknown compression: " << compress << std::endl;
+        exit(1);
+    }
+
+    auto numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    auto threads = findOption(argc, argv, "threads");
+    if (!threads.empty()) numThreads = static_cast<unsigned int>(std::max(std::stoi(threads), 1));
+
+    mkdir(convertOutputDir.c_str(), ALLPERMS);
+
+    std::atomic<unsigned int> nextFrame(startFrame);
+    std::atomic<unsigned int> numFailed(0);
+    std::atomic<size_t> bytesRead(0);
+
+    auto timeStart = std::chrono::system_clock::now();
+
+    auto work = [&]() {
+#ifdef _OPENMP
+        // Frames are already processed in parallel
+        if (numThreads > 1) omp_set_num_threads(1);
+#endif
+
+        // Reused across frames
+        SOLVER frameSolver(0, glm::uvec3());
+        std::vector<std::string> fields;
+        std::vector<char> buffer;
+        StateFileView state; // Keeps the keyframe of delta frames mapped and decoded across frames
+
+        for (auto frame = nextFrame++; frame < endFrame; frame = nextFrame++) {
+            auto filename = convertFilename(inputDir, frame, SOLVER_STATE_EXT);
+
+            struct stat fileStat{};
+            if (stat(filename.c_str(), &fileStat) != 0) {
+                LOG(ERROR) << "Frame " << frame << " is missing: " << filename << std::endl;
+                numFailed++;
+                continue;
+            }
+            bytesRead += static_cast<size_t>(fileStat.st_size);
+
+            frameSolver.particleNodes.clear();
+
+            // Legacy frames hold every column
+            fields.clear();
+            state.open(filename);
+            for (auto c = 0u; state.isOpen() && c < state.header().numColumns; c++) {
+                fields.emplace_back(state.columns()[c].name);
+            }
+
+            if (!(state.isOpen() ? frameSolver.loadState(state) : frameSolver.loadState(filename))) {
+                LOG(ERROR) << "Frame " << frame << " could not be loaded: " << filename << std::endl;
+                numFailed++;
+                continue;
+            }
+
+            if (!output->write(frame, frameSolver, fields, buffer)) {
+                LOG(ERROR) << "Frame " << frame << " could not be converted" << std::endl;
+                numFailed++;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (auto i = 0; i < numThreads; i++) {
+        workers.emplace_back(work);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    auto finished = output->finish();
+
+    auto seconds = std::chrono::duration<double>(std::chrono::system_clock::now() - timeStart).count();
+    std::cout << "Converted " << (endFrame > startFrame ? endFrame - startFrame : 0) - numFailed << " frames with "
+              << numThreads << " threads in " << seconds << "s (" << (seconds > 0 ? bytesRead / seconds : 0) / 1e6
+              << " MB/s read)" << std::endl;
+
+    if (!finished) LOG(ERROR) << "Output could not be finished" << std::endl;
+    if (numFailed || !finished) exit(1);
+
+}
+
+
+#endif //SNOW_CONVERT_H
@@ -0,0 +1,194 @@
+#ifndef SNOW_FRAME_PREFETCHER_H
+#define SNOW_FRAME_PREFETCHER_H
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../lib/StateFile.h"
+
+
+/**
+ * Columns of a frame, decoded for display
+ */
+struct VizFrame {
+    unsigned int index;
+    bool loaded; // False if the file is missing or was written before StateFile
+    size_t numParticles;
+    std::map<std::string, std::vector<double>> columns;
+
+    /**
+     * Values of a column, nullptr if the frame does not hold it
+     */
+    double const *column(std::string const &name) const {
+        auto values = columns.find(name);
+        return values == columns.end() || values->second.empty() ? nullptr : values->second.data();
+    }
+
+    size_t bytes() const {
+        size_t bytes = 0;
+        for (auto const &column : columns) bytes += column.second.size() * sizeof(double);
+        return bytes;
+    }
+};
+
+
+/**
+ * Decodes the frames following the displayed one on a background thread
+ * Decoded frames wait in a ring of buffers, as many as fit in the memory budget, so the render thread only waits
+ * when decoding falls behind or after a seek
+ */
+class FramePrefetcher {
+public:
+
+    /**
+     * filename maps frame indices, as passed to get, to files
+     */
+    FramePrefetcher(std::function<std::string(unsigned int)> filename, std::vector<std::string> fields,
+                    unsigned int firstFrame, size_t memoryBudget, size_t maxFrames = 16)
+            : filename(filename), fields(fields), memoryBudget(memoryBudget), frames(maxFrames + 1),
+              nextFrame(firstFrame) {
+        for (auto &frame : frames) {
+            freeFrames.push_back(&frame);
+        }
+        thread = std::thread(&FramePrefetcher::run, this);
+    }
+
+    FramePrefetcher(FramePrefetcher const &) = delete;
+
+    FramePrefetcher &operator=(FramePrefetcher const &) = delete;
+
+    ~FramePrefetcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join();
+    }
+
+    /**
+     * Waits for a frame to be decoded, prefetching restarts from it if it is not the one expected next
+     * The frame stays valid until the next call
+     */
+    VizFrame const &get(unsigned int index) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (displayedFrame) freeFrames.push_back(displayedFrame);
+        displayedFrame = nullptr;
+        changed.notify_all();
+
+        while (true) {
+            while (!readyFrames.empty() && readyFrames.front()->index != index) {
+                freeFrames.push_back(readyFrames.front());
+                readyFrames.pop_front();
+            }
+            if (!readyFrames.empty()) break;
+
+            if (nextFrame != index && !(isDecoding && decodingFrame == index)) {
+                nextFrame = index;
+                generation++;
+                changed.notify_all();
+            }
+
+            changed.wait(lock);
+        }
+
+        displayedFrame = readyFrames.front();
+        readyFrames.pop_front();
+        changed.notify_all();
+
+        return *displayedFrame;
+    }
+
+private:
+
+    std::function<std::string(unsigned int)> filename;
+    std::vector<std::string> fields;
+    size_t memoryBudget;
+
+    std::vector<VizFrame> frames;
+    std::deque<VizFrame *> freeFrames;
+    std::deque<VizFrame *> readyFrames;
+    VizFrame *displayedFrame = nullptr;
+
+    size_t depth = 1; // Frames decoded ahead, sized once a frame is decoded
+    unsigned int nextFrame;
+    unsigned int generation = 0; // Changed on seeks, frames decoded before are dropped
+    bool isDecoding = false;
+    unsigned int decodingFrame = 0;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+
+    std::thread thread;
+
+    StateFileView state; // Keeps the keyframe of delta frames mapped across frames
+
+    void run() {
+        while (true) {
+            VizFrame *frame;
+            unsigned int frameGeneration;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] {
+                    return stopping || (!freeFrames.empty() && readyFrames.size() < depth);
+                });
+                if (stopping) return;
+
+                frame = freeFrames.front();
+                freeFrames.pop_front();
+                frame->index = nextFrame++;
+                frameGeneration = generation;
+                isDecoding = true;
+                decodingFrame = frame->index;
+            }
+
+            decode(*frame);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isDecoding = false;
+                if (frameGeneration == generation) {
+                    readyFrames.push_back(frame);
+                } else {
+                    freeFrames.push_back(frame);
+                }
+
+                auto bytes = std::max(frame->bytes(), static_cast<size_t>(1));
+                depth = std::max(static_cast<size_t>(1), std::min(memoryBudget / bytes, frames.size() - 1));
+            }
+            changed.notify_all();
+        }
+    }
+
+    void decode(VizFrame &frame) {
+        frame.loaded = state.open(filename(frame.index));
+        frame.numParticles = frame.loaded ? state.numParticles() : 0;
+
+        for (auto const &field : fields) {
+            auto &values = frame.columns[field];
+            auto column = frame.loaded ? state.column(field) : nullptr;
+            auto components = column ? column->components : 0;
+
+            auto copy = [&values, components](size_t p, double const *particleValues) {
+                std::copy_n(particleValues, components, &values[p * components]);
+            };
+
+            values.resize(frame.numParticles * components);
+            if (!column || !state.readColumn<double>(field, components, copy)) values.clear();
+        }
+    }
+
+};
+
+
+#endif //SNOW_FRAME_PREFETCHER_H
@@ -0,0 +1,163 @@
+#ifndef SNOW_FRAME_WRITER_H
+#define SNOW_FRAME_WRITER_H
+
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logging.h"
+
+#include "../../lib/FrameIndex.h"
+#include "../../lib/Trace.h"
+
+
+/**
+ * Writes packed frames on a background thread
+ * A fixed number of buffers cycle between the caller, which packs frames into them, and the writer thread, so at
+ * most that many frames are held in memory and the caller only waits when all of them are still being written
+ * Frames are added to the frame index, if there is one, once they are on disk, and writes are traced if there is a
+ * trace
+ */
+class FrameWriter {
+public:
+
+    struct Frame {
+        unsigned int index;
+        std::string filename;
+        std::vector<char> buffer; // Reused, only grows
+        size_t bytes;
+        FRAME_INDEX_RECORD record;
+    };
+
+    explicit FrameWriter(size_t numBuffers = 2, FrameIndexWriter *frameIndex = nullptr, TraceSink *trace = nullptr)
+            : frames(numBuffers), frameIndex(frameIndex), trace(trace) {
+        for (auto &frame : frames) {
+            freeFrames.push_back(&frame);
+        }
+        thread = std::thread(&FrameWriter::run, this);
+    }
+
+    FrameWriter(FrameWriter const &) = delete;
+
+    FrameWriter &operator=(FrameWriter const &) = delete;
+
+    ~FrameWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        thread.join(); // Drains the queue first
+    }
+
+    /**
+     * Waits for a buffer to pack the next frame into
+     */
+    Frame &acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !freeFrames.empty(); });
+        auto frame = freeFrames.front();
+        freeFrames.pop_front();
+        return *frame;
+    }
+
+    /**
+     * Queues an acquired frame for writing
+     */
+    void submit(Frame &frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingFrames.push_back(&frame);
+        }
+        changed.notify_all();
+    }
+
+    /**
+     * Bytes held by the frame buffers, called from the thread that packs the frames
+     */
+    size_t memoryUsage() const {
+        size_t bytes = 0;
+        for (auto const &frame : frames) {
+            bytes += frame.buffer.capacity();
+        }
+        return bytes;
+    }
+
+    /**
+     * Waits until every submitted frame is on disk
+     */
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return freeFrames.size() == frames.size(); });
+    }
+
+private:
+
+    std::vector<Frame> frames;
+    FrameIndexWriter *frameIndex;
+    TraceSink *trace;
+    std::deque<Frame *> freeFrames;
+    std::deque<Frame *> pendingFrames;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool stopping = false;
+
+    std::thread thread;
+
+    void run() {
+        while (true) {
+            Frame *frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return stopping || !pendingFrames.empty(); });
+                if (pendingFrames.empty()) return;
+                frame = pendingFrames.front();
+                pendingFrames.pop_front();
+            }
+
+            auto timeLast = std::chrono::system_clock::now();
+            auto traceStart = TraceSink::clock::now();
+
+            std::ofstream file;
+            file.open(frame->filename, std::ofstream::binary | std::ofstream::trunc);
+            file.write(frame->buffer.data(), frame->bytes);
+            file.close();
+
+            auto timeNow = std::chrono::system_clock::now();
+            auto seconds = std::chrono::duration<double>(timeNow - timeLast).count();
+
+            if (trace) trace->complete("write", "io", traceStart, TraceSink::clock::now(), "bytes", frame->bytes);
+
+            if (file) {
+                // Through the logger rather than std::cout, which the simulation loop prints to concurrently
+                LOG(INFO) << "Frame " << frame->index << " written to: " << frame->filename
+                          << " (" << frame->bytes << " bytes, " << (seconds > 0 ? frame->bytes / seconds : 0) / 1e6
+                          << " MB/s)" << std::endl;
+
+                if (frameIndex && !frameIndex->append(frame->record)) {
+                    LOG(ERROR) << "Frame " << frame->index << " could not be indexed" << std::endl;
+                }
+            } else {
+                LOG(ERROR) << "Frame " << frame->index << " could not be written to: " << frame->filename
+                           << std::endl;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                freeFrames.push_back(frame);
+            }
+            changed.notify_all();
+        }
+    }
+
+};
+
+
+#endif //SNOW_FRAME_WRITER_H
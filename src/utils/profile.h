@@ -0,0 +1,119 @@
+#ifndef SNOW_PROFILE_H
+#define SNOW_PROFILE_H
+
+
+#include <fstream>
+#include <string>
+
+#include "../../lib/Profiler.h"
+
+
+/**
+ * Phase times of every frame, as CSV with one line per frame and phase, or as a JSON array with one object per frame
+ * The format follows the extension of the file name, phases that did not run during a frame are left out
+ * Available hardware counters are added as totals, and as rates per tick and particle or grid node
+ */
+class ProfileLog {
+public:
+
+    ProfileLog() = default;
+
+    ProfileLog(ProfileLog const &) = delete;
+
+    ProfileLog &operator=(ProfileLog const &) = delete;
+
+    ~ProfileLog() {
+        close();
+    }
+
+    bool open(std::string const &filename, PerfCounters const *counters = nullptr) {
+        close();
+
+        for (auto c = 0; c < PERF_COUNTERS; c++) {
+            available[c] = counters && counters->isAvailable(c);
+        }
+
+        std::string ext = ".json";
+        isJson = filename.size() >= ext.size() && filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+        numFrames = 0;
+
+        file.open(filename, std::ofstream::trunc);
+        if (isJson) {
+            file << "[";
+        } else {
+            file << "frame,ticks,phase,calls,seconds";
+            for (auto c = 0; c < PERF_COUNTERS; c++) {
+                auto name = PerfCounters::names[c];
+                if (available[c]) file << "," << name << "," << name << "_per_particle," << name << "_per_grid_node";
+            }
+            file << "\n";
+        }
+        return static_cast<bool>(file);
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    /**
+     * Appends the times accumulated by the profiler, flushed so the log can be followed while simulating
+     */
+    void write(unsigned int frame, unsigned int ticks, Profiler const &profiler, size_t numParticles,
+               size_t numGridNodes) {
+        if (isJson) {
+            file << (numFrames ? ",\n" : "\n") << "  {\"frame\": " << frame << ", \"ticks\": " << ticks
+                 << ", \"phases\": {";
+        }
+
+        auto first = true;
+        for (auto const &phase : profiler.getPhases()) {
+            if (!phase.calls) continue;
+
+            if (isJson) {
+                file << (first ? "" : ", ") << "\"" << phase.name << "\": {\"calls\": " << phase.calls
+                     << ", \"seconds\": " << phase.seconds;
+            } else {
+                file << frame << "," << ticks << "," << phase.name << "," << phase.calls << "," << phase.seconds;
+            }
+
+            for (auto c = 0; c < PERF_COUNTERS; c++) {
+                if (!available[c]) continue;
+
+                double count = phase.counters[c];
+                auto perParticle = numParticles ? count / (phase.calls * numParticles) : 0;
+                auto perGridNode = numGridNodes ? count / (phase.calls * numGridNodes) : 0;
+
+                if (isJson) {
+                    file << ", \"" << PerfCounters::names[c] << "\": {\"total\": " << phase.counters[c]
+                         << ", \"per_particle\": " << perParticle << ", \"per_grid_node\": " << perGridNode << "}";
+                } else {
+                    file << "," << phase.counters[c] << "," << perParticle << "," << perGridNode;
+                }
+            }
+
+            file << (isJson ? "}" : "\n");
+            first = false;
+        }
+
+        if (isJson) file << "}}";
+        file.flush();
+        numFrames++;
+    }
+
+    void close() {
+        if (!isOpen()) return;
+        if (isJson) file << "\n]\n";
+        file.close();
+    }
+
+private:
+
+    std::ofstream file;
+    bool isJson = false;
+    unsigned int numFrames = 0;
+    bool available[PERF_COUNTERS] = {};
+
+};
+
+
+#endif //SNOW_PROFILE_H
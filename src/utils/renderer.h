@@ -1,8 +1,11 @@
 #ifndef SNOW_RENDERER_H
 #define SNOW_RENDERER_H
 
+#include <algorithm>
 #include <chrono>
 
+#include <glm/gtc/type_ptr.hpp>
+
 #ifndef USE_RENDERBOX
 #error "RenderBox is required for viz"
 #endif //USE_RENDERBOX
@@ -14,6 +17,7 @@
 #include "renderbox.h"
 
 #include "common.h"
+#include "frame-prefetcher.h"
 
 
 static std::unique_ptr<renderbox::OpenGLRenderer> renderer;
@@ -30,6 +34,12 @@ static std::shared_ptr<renderbox::Material> colliderMaterial;
 static std::shared_ptr<renderbox::Object> particles;
 static std::shared_ptr<renderbox::Object> ghostParticles;
 
+// Frames being displayed, decoded ahead instead of being loaded into the solvers
+static std::unique_ptr<FramePrefetcher> framePrefetcher;
+static std::unique_ptr<FramePrefetcher> ghostFramePrefetcher;
+static VizFrame const *vizFrame = nullptr;
+static VizFrame const *ghostVizFrame = nullptr;
+
 static std::shared_ptr<renderbox::Geometry> snowParticleGeometry;
 static std::shared_ptr<renderbox::Material> snowParticleMaterial;
 static std::shared_ptr<renderbox::Material> ghostSnowParticleMaterial;
@@ -78,28 +88,81 @@ static void rotateCallback(GLFWwindow *window, double rotation) {
 
 #endif //VIZ_RENDER
 
-static void updateVizParticlePositions() {
+template<typename F>
+static void updateVizParticlePositions(renderbox::Object *object, size_t numParticles, F const &position) {
 
-    auto numParticles = solver->particleNodes.size();
+    numParticles = std::min(numParticles, object->children.size());
     for (auto i = 0; i < numParticles; i++) {
-        particles->children[i]->setTranslation(solver->particleNodes[i].position);
+        object->children[i]->setTranslation(position(i));
+    }
 
-#ifdef SOLVER_LAVA
-        if (solver->particleNodes[i].temperature > solver->particleNodes[i].fusionTemperature + FLT_EPSILON) {
-            particles->children[i]->setMaterial(lavaParticleLiquidMaterial);
-        } else if (solver->particleNodes[i].temperature < solver->particleNodes[i].fusionTemperature - FLT_EPSILON) {
-            particles->children[i]->setMaterial(snowParticleMaterial);
+}
+
+template<typename T, typename F>
+static void updateVizParticleMaterials(renderbox::Object *object, size_t numParticles, T const &temperature,
+                                       F const &fusionTemperature) {
+
+    numParticles = std::min(numParticles, object->children.size());
+    for (auto i = 0; i < numParticles; i++) {
+        if (temperature(i) > fusionTemperature(i) + FLT_EPSILON) {
+            object->children[i]->setMaterial(lavaParticleLiquidMaterial);
+        } else if (temperature(i) < fusionTemperature(i) - FLT_EPSILON) {
+            object->children[i]->setMaterial(snowParticleMaterial);
         } else {
-            particles->children[i]->setMaterial(lavaParticlePhaseChangeMaterial);
+            object->children[i]->setMaterial(lavaParticlePhaseChangeMaterial);
+        }
+    }
+
+}
+
+static void updateVizParticlePositions() {
+
+    if (vizFrame && vizFrame->loaded) {
+        auto numParticles = vizFrame->numParticles;
+
+        auto positions = vizFrame->column("position");
+        if (positions) {
+            updateVizParticlePositions(particles.get(), numParticles, [positions](size_t i) {
+                return glm::make_vec3(positions + 3 * i);
+            });
+        }
+
+#ifdef SOLVER_LAVA
+        auto temperatures = vizFrame->column("temperature");
+        auto fusionTemperatures = vizFrame->column("fusionTemperature");
+        if (temperatures && fusionTemperatures) {
+            updateVizParticleMaterials(particles.get(), numParticles,
+                                       [temperatures](size_t i) { return temperatures[i]; },
+                                       [fusionTemperatures](size_t i) { return fusionTemperatures[i]; });
         }
+#endif
+    } else {
+        auto const &particleNodes = solver->particleNodes;
+
+        updateVizParticlePositions(particles.get(), particleNodes.size(), [&particleNodes](size_t i) {
+            return particleNodes[i].position;
+        });
+
+#ifdef SOLVER_LAVA
+        updateVizParticleMaterials(particles.get(), particleNodes.size(),
+                                   [&particleNodes](size_t i) { return particleNodes[i].temperature; },
+                                   [&particleNodes](size_t i) { return particleNodes[i].fusionTemperature; });
 #endif
     }
 
-    if (ghostSolver) {
-        auto numGhostParticles = ghostSolver->particleNodes.size();
-        for (auto i = 0; i < numGhostParticles; i++) {
-            ghostParticles->children[i]->setTranslation(ghostSolver->particleNodes[i].position);
+    if (ghostVizFrame && ghostVizFrame->loaded) {
+        auto positions = ghostVizFrame->column("position");
+        if (positions) {
+            updateVizParticlePositions(ghostParticles.get(), ghostVizFrame->numParticles, [positions](size_t i) {
+                return glm::make_vec3(positions + 3 * i);
+            });
         }
+    } else if (ghostSolver) {
+        auto const &particleNodes = ghostSolver->particleNodes;
+
+        updateVizParticlePositions(ghostParticles.get(), particleNodes.size(), [&particleNodes](size_t i) {
+            return particleNodes[i].position;
+        });
     }
 
 }
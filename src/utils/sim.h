@@ -5,54 +5,308 @@
 #include <memory>
 #include <sstream>
 #include <chrono>
+#include <fstream>
+#include <iomanip>
 
+#include <dirent.h>
+
+#include "../../lib/memory_usage.h"
 #include "common.h"
+#include "frame-writer.h"
+#include "profile.h"
 
 
 static unsigned int fps = 60;
 static unsigned int timedFrames;
 static unsigned int totalFrames;
+static unsigned int frameTicks; // Of the frame being simulated
+
+static StateFileCompression frameCompression = STATE_FILE_UNCOMPRESSED;
+static std::unique_ptr<StateFileKeyframes> frameKeyframes; // Frames are delta encoded if set
+
+static FrameIndexWriter frameIndex;
+
+// Steps of the solver, timed if a profile or a trace is written
+static Profiler profiler;
+static ProfileLog profileLog;
+static TraceSink trace;
+static PerfCounters counters;
+
+/**
+ * Frames between full checkpoints, frames only hold the viz fields if set
+ * Otherwise every frame holds the full state, as before checkpoints
+ */
+static unsigned int checkpointInterval = 0;
 
+/**
+ * Time accumulated over the ticks of a frame lands on the frame time up to rounding
+ */
+static double const frameTimeTolerance = 1e-9;
+
+
+static std::string frameFilename(char const *prefix, unsigned int frame) {
+    std::ostringstream filename;
+    filename << prefix << "-" << frame << SOLVER_STATE_EXT;
+    return filename.str();
+}
+
+/**
+ * Frame of the last checkpoint in the working directory, false if there is none
+ */
+static bool findLatestCheckpoint(unsigned int &frame) {
+    auto dir = opendir(".");
+    if (!dir) return false;
+
+    std::string prefix = "checkpoint-";
+    std::string ext = SOLVER_STATE_EXT;
+    auto found = false;
+
+    while (auto entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= prefix.size() + ext.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - ext.size(), ext.size(), ext) != 0) {
+            continue;
+        }
+
+        auto number = name.substr(prefix.size(), name.size() - prefix.size() - ext.size());
+        if (number.find_first_not_of("0123456789") != std::string::npos) continue;
+
+        auto checkpoint = static_cast<unsigned int>(std::stoul(number));
+        if (!found || checkpoint > frame) frame = checkpoint;
+        found = true;
+    }
+
+    closedir(dir);
+    return found;
+}
+/**
+ * Bytes of the solver structures, of the frames being written if there is a frame writer, and the peak resident set of
+ * the process, in MiB
+ */
+static void printMemoryUsage(FrameWriter const *frameWriter = nullptr) {
+    auto mib = 1.0 / (1024 * 1024);
+    size_t total = 0;
+
+    auto usages = solver->memoryUsage();
+    if (frameWriter) usages.push_back({"frame_buffers", frameWriter->memoryUsage()});
+    if (frameKeyframes) usages.push_back({"keyframes", frameKeyframes->memoryUsage()});
+
+    std::cout << "memory" << std::fixed << std::setprecision(1);
+    for (auto const &usage : usages) {
+        std::cout << " " << usage.name << "=" << usage.bytes * mib << "MiB";
+        total += usage.bytes;
+    }
+    std::cout << " total=" << total * mib << "MiB peak_rss=" << peakResidentSetSize() * mib << "MiB"
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+/**
+ * Indexes the frame the run resumes from if the index lacks it, e.g. frame 0 as written by the scene generators
+ */
+static void indexStartFrame(std::string const &filename, bool isCheckpoint) {
+    auto flags = isCheckpoint ? static_cast<uint32_t>(FRAME_INDEX_CHECKPOINT) : 0u;
+
+    FrameIndexView index(FRAME_INDEX_FILENAME);
+    if (!frameIndex.isOpen() || (index.isOpen() && index.find(timedFrames, flags))) return;
+
+    StateFileView state(filename);
+    std::ifstream file(filename, std::ifstream::binary | std::ifstream::ate);
+
+    auto record = FRAME_INDEX_RECORD{};
+    record.frame = timedFrames;
+    record.flags = flags;
+    record.tick = solver->getTick();
+    record.time = solver->getTime();
+    record.bytes = static_cast<uint64_t>(file.tellg());
+    record.tableOffset = state.isOpen() ? state.header().tableOffset : 0;
+    computeFrameIndexStats(record, solver->particleNodes);
+
+    if (!frameIndex.append(record)) {
+        LOG(ERROR) << "Frame " << timedFrames << " could not be indexed" << std::endl;
+    }
+}
 
 static void initSim(int argc, char const **argv) {
 
-    timedFrames = static_cast<unsigned int>(std::stoi(argv[2]));
+    if (std::string(argv[2]) == "latest") {
+        if (!findLatestCheckpoint(timedFrames)) {
+            std::cout << "No checkpoint to resume from" << std::endl;
+            exit(1);
+        }
+    } else {
+        timedFrames = static_cast<unsigned int>(std::stoi(argv[2]));
+    }
     totalFrames = static_cast<unsigned int>(std::stoi(argv[3]));
 
-    // Simulation
+    auto compress = findOption(argc, argv, "compress");
+    if (compress == "lossless") {
+        frameCompression = STATE_FILE_LOSSLESS;
+    } else if (compress == "lossy") {
+        frameCompression = STATE_FILE_LOSSY;
+    } else if (!compress.empty()) {
+        std::cout << "Unknown compression: " << compress << std::endl;
+        exit(1);
+    }
 
-    std::ostringstream filename;
-    filename << "frame-" << timedFrames << SOLVER_STATE_EXT;
-    solver.reset(new SOLVER(filename.str()));
+    auto keyframeInterval = findOption(argc, argv, "keyframe-interval");
+    if (!keyframeInterval.empty() && std::stoi(keyframeInterval) > 1) {
+        frameKeyframes.reset(new StateFileKeyframes(static_cast<uint32_t>(std::stoi(keyframeInterval))));
+    }
+
+    auto checkpoints = findOption(argc, argv, "checkpoint-interval");
+    if (!checkpoints.empty()) checkpointInterval = static_cast<unsigned int>(std::stoi(checkpoints));
+
+    // Simulation, from the checkpoint of the start frame if there is one
+
+    auto filename = frameFilename("checkpoint", timedFrames);
+    if (!std::ifstream(filename)) filename = frameFilename("frame", timedFrames);
+
+    StateFileView state(filename);
+    if (state.isOpen() && !state.column("mass")) {
+        std::cout << filename << " only holds viz fields, resume from a checkpoint" << std::endl;
+        exit(1);
+    }
+    state.close();
+
+    std::cout << "Resuming from: " << filename << std::endl;
+    solver.reset(new SOLVER(filename));
+    printMemoryUsage();
+
+    // Adaptive time steps, bounded by the time step the scene was generated with
+    auto cfl = findOption(argc, argv, "cfl");
+    if (!cfl.empty()) solver->cfl = std::stod(cfl);
+
+    auto profile = findOption(argc, argv, "profile");
 
+    // Opened before any parallel step, on the threads that run them
+    if (findFlag(argc, argv, "perf-counters")) {
+        if (profile.empty()) {
+            std::cout << "Hardware counters are only written to profiles, --perf-counters needs --profile"
+                      << std::endl;
+            exit(1);
+        }
+        if (counters.open()) {
+            profiler.counters = &counters;
+        } else {
+            std::cout << "Hardware counters are unavailable, profiling wall time only" << std::endl;
+        }
+    }
+
+    if (!profile.empty()) {
+        if (!profileLog.open(profile, profiler.counters)) {
+            std::cout << "Unable to write profile: " << profile << std::endl;
+            exit(1);
+        }
+        solver->profiler = &profiler;
+    }
+
+    auto traceFilename = findOption(argc, argv, "trace");
+    if (!traceFilename.empty()) {
+        if (!trace.open(traceFilename)) {
+            std::cout << "Unable to write trace: " << traceFilename << std::endl;
+            exit(1);
+        }
+        profiler.trace = &trace;
+        solver->profiler = &profiler;
+    }
+
+#ifdef SOLVER_LAVA
+    auto solverType = STATE_FILE_SOLVER_LAVA;
+#else
+    auto solverType = STATE_FILE_SOLVER_SNOW;
+#endif
+    if (!frameIndex.open(FRAME_INDEX_FILENAME, solverType)) {
+        LOG(ERROR) << "Frames are not indexed, " FRAME_INDEX_FILENAME " cannot be opened" << std::endl;
+    }
+    indexStartFrame(filename, filename == frameFilename("checkpoint", timedFrames));
+
+}
+
+/**
+ * Packs the state into a frame and queues it for writing
+ */
+static void writeFrame(FrameWriter &frameWriter, std::string const &filename, bool isCheckpoint) {
+    auto &frame = frameWriter.acquire();
+    frame.index = timedFrames;
+    frame.filename = filename;
+
+    if (isCheckpoint) {
+        // Checkpoints are resumed from, so they are never lossy nor depend on other frames
+        auto compression = frameCompression == STATE_FILE_LOSSY ? STATE_FILE_LOSSLESS : frameCompression;
+        frame.bytes = solver->packState(frame.buffer, compression);
+    } else {
+        if (frameKeyframes) frameKeyframes->frame = timedFrames;
+        frame.bytes = solver->packState(frame.buffer, frameCompression, frameKeyframes.get(),
+                                        checkpointInterval ? SOLVER::vizFields : std::vector<std::string>());
+    }
+
+    frame.record = FRAME_INDEX_RECORD{};
+    frame.record.frame = timedFrames;
+    frame.record.flags = isCheckpoint ? FRAME_INDEX_CHECKPOINT : 0;
+    frame.record.tick = solver->getTick();
+    frame.record.time = solver->getTime();
+    frame.record.ticks = frameTicks;
+    frame.record.bytes = frame.bytes;
+    frame.record.tableOffset = reinterpret_cast<STATE_FILE_HEADER const *>(frame.buffer.data())->tableOffset;
+    computeFrameIndexStats(frame.record, solver->particleNodes);
+
+    frameWriter.submit(frame);
 }
 
 static void startSimLoop() {
 
+    // Flushed when the loop ends
+    FrameWriter frameWriter(2, frameIndex.isOpen() ? &frameIndex : nullptr, trace.isOpen() ? &trace : nullptr);
+
     // Render loop
 
     while (timedFrames + 1 < totalFrames) {
 
         std::cout << "tick=" << solver->getTick() << " time=" << solver->getTime() << std::endl;
 
+        auto frameTime = 1.0 * (timedFrames + 1) / fps;
+        solver->chooseTimeStep(frameTime);
+
         auto timeLast = std::chrono::system_clock::now();
-        solver->update(); // Run simulation
+        {
+            ProfilerScope phase(solver->profiler, "update");
+            solver->update(); // Run simulation
+        }
         auto timeNow = std::chrono::system_clock::now();
         auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timeNow - timeLast);
         std::cout << ms.count() << "ms" << std::endl;
 
-        if (solver->getTime() > 1.0 * (timedFrames + 1) / fps) {
+        frameTicks++;
+
+        if (solver->getTime() > frameTime - frameTimeTolerance) {
             timedFrames++;
+            std::cout << "frame=" << timedFrames << " ticks=" << frameTicks << std::endl;
+            printMemoryUsage(&frameWriter);
 
-            std::ostringstream filename;
-            filename << "frame-" << timedFrames << SOLVER_STATE_EXT;
-            solver->saveState(filename.str());
+            // Snapshot the state and keep simulating while it is written
+            ProfilerScope phase(solver->profiler, "write_frame");
+            writeFrame(frameWriter, frameFilename("frame", timedFrames), false);
+            if (checkpointInterval && (timedFrames % checkpointInterval == 0 || timedFrames + 1 == totalFrames)) {
+                writeFrame(frameWriter, frameFilename("checkpoint", timedFrames), true);
+            }
+            phase.next(nullptr);
 
-            std::cout << "Frame " << timedFrames << " written to: " << filename.str() << std::endl;
+            // Writes are timed with the frame they were queued in
+            if (profileLog.isOpen()) {
+                profileLog.write(timedFrames, frameTicks, profiler, solver->particleNodes.size(),
+                                 solver->size.x * solver->size.y * solver->size.z);
+            }
+            profiler.reset();
+
+            frameTicks = 0;
         }
 
     }
 
+    frameWriter.flush();
+    profileLog.close();
+    trace.close();
+
 }
 
 
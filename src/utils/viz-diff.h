@@ -12,6 +12,15 @@ static unsigned int endFrame;
 static std::string dirA;
 static std::string dirB;
 
+static size_t prefetchMemory = 512; // MB, shared by both sequences
+
+
+static std::string vizFrameFilename(std::string const &dir, unsigned int frame) {
+    unsigned int wrappedFrame = startFrame + frame % (endFrame - startFrame);
+    std::ostringstream filename;
+    filename << "frame-" << wrappedFrame << SOLVER_STATE_EXT;
+    return joinPath(dir, filename.str());
+}
 
 static void initVizDiff(int argc, char const **argv) {
 
@@ -29,6 +38,14 @@ static void initVizDiff(int argc, char const **argv) {
     solver.reset(new SOLVER(joinPath(dirA, filename.str())));
     ghostSolver.reset(new SOLVER(joinPath(dirB, filename.str())));
 
+    auto memory = findOption(argc, argv, "prefetch-memory");
+    if (!memory.empty()) prefetchMemory = static_cast<size_t>(std::stoul(memory));
+
+    framePrefetcher.reset(new FramePrefetcher([](unsigned int frame) { return vizFrameFilename(dirA, frame); },
+                                              SOLVER::vizFields, 1, prefetchMemory << 19));
+    ghostFramePrefetcher.reset(new FramePrefetcher([](unsigned int frame) { return vizFrameFilename(dirB, frame); },
+                                                   {"position"}, 1, prefetchMemory << 19));
+
     // Rendering
 
     initRenderer();
@@ -37,12 +54,16 @@ static void initVizDiff(int argc, char const **argv) {
 
 static void vizDiffRenderLoopUpdate(unsigned int frame) {
 
-    unsigned int wrappedFrame = startFrame + frame % (endFrame - startFrame);
-    std::ostringstream filename;
-    filename << "frame-" << wrappedFrame << SOLVER_STATE_EXT;
+    vizFrame = &framePrefetcher->get(frame);
+    ghostVizFrame = &ghostFramePrefetcher->get(frame);
 
-    solver->loadState(joinPath(dirA, filename.str()));
-    ghostSolver->loadState(joinPath(dirB, filename.str()));
+    // Frames written before StateFile cannot be decoded ahead, they are loaded into the solvers instead
+    if (!vizFrame->loaded) {
+        solver->loadState(vizFrameFilename(dirA, frame));
+    }
+    if (!ghostVizFrame->loaded) {
+        ghostSolver->loadState(vizFrameFilename(dirB, frame));
+    }
 
 }
 
@@ -16,11 +16,20 @@ static unsigned int endFrame;
 
 static std::string dir;
 
+static size_t prefetchMemory = 512; // MB
+
 #ifdef VIZ_RENDER
 static std::string renderOutputDir;
 #endif //VIZ_RENDER
 
 
+static std::string vizFrameFilename(std::string const &dir, unsigned int frame) {
+    unsigned int wrappedFrame = startFrame + frame % (endFrame - startFrame);
+    std::ostringstream filename;
+    filename << "frame-" << wrappedFrame << SOLVER_STATE_EXT;
+    return joinPath(dir, filename.str());
+}
+
 static void initViz(int argc, char const **argv) {
 
     startFrame = static_cast<unsigned int>(atoi(argv[3]));
@@ -39,6 +48,12 @@ static void initViz(int argc, char const **argv) {
 
     solver.reset(new SOLVER(joinPath(dir, filename.str())));
 
+    auto memory = findOption(argc, argv, "prefetch-memory");
+    if (!memory.empty()) prefetchMemory = static_cast<size_t>(std::stoul(memory));
+
+    framePrefetcher.reset(new FramePrefetcher([](unsigned int frame) { return vizFrameFilename(dir, frame); },
+                                              SOLVER::vizFields, 1, prefetchMemory << 20));
+
     // Rendering
 
     initRenderer();
@@ -47,10 +62,12 @@ static void initViz(int argc, char const **argv) {
 
 static void vizRenderLoopUpdate(unsigned int frame) {
 
-    unsigned int wrappedFrame = startFrame + frame % (endFrame - startFrame);
-    std::ostringstream filename;
-    filename << "frame-" << wrappedFrame << SOLVER_STATE_EXT;
-    solver->loadState(joinPath(dir, filename.str()));
+    vizFrame = &framePrefetcher->get(frame);
+
+    // Frames written before StateFile cannot be decoded ahead, they are loaded into the solver instead
+    if (!vizFrame->loaded) {
+        solver->loadState(vizFrameFilename(dir, frame));
+    }
 
 }
 
@@ -6,7 +6,7 @@
 
 void launchVizDiffScene0(int argc, char const **argv) {
     if (argc < 6) {
-        std::cout << "Usage: ./snow viz-diff-scene0 dir-a dir-b frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow viz-diff-scene0 dir-a dir-b frame end-frame [--prefetch-memory=mb]" << std::endl;
         exit(1);
     }
 
@@ -7,7 +7,7 @@
 
 void launchVizScene0(int argc, char const **argv) {
     if (argc < 5) {
-        std::cout << "Usage: ./snow viz-scene0 dir frame end-frame" << std::endl;
+        std::cout << "Usage: ./snow viz-scene0 dir frame end-frame [--prefetch-memory=mb]" << std::endl;
         exit(1);
     }
 
@@ -4,6 +4,9 @@
 #include <boost/test/unit_test_suite.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/test/test_tools.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <ostream>
 
 namespace tt = boost::test_tools;
@@ -11,6 +14,9 @@ namespace tt = boost::test_tools;
 #include "../lib/conjugate_residual_solver.h"
 #include "../lib/SnowSolver.h"
 #include "../lib/LavaSolver.h"
+#include "../lib/FrameIndex.h"
+#include "../lib/Profiler.h"
+#include "../lib/CounterRandom.h"
 
 
 // A[3x3]
@@ -33,6 +39,86 @@ std::ostream &operator<<(std::ostream &os, std::vector<T> const &vector) {
     return os;
 }
 
+/**
+ * Reaches the private steps of the solvers
+ */
+class SolverTests {
+public:
+
+    /**
+     * Two cells of unit heat capacity, coupled by a unit conductivity through the face between them
+     */
+    static void makeHeatCells(LavaSolver &solver, double temperature0, double temperature1) {
+        solver.propagateSimulationParametersUpdate();
+
+        for (auto c = 0; c < 2; c++) {
+            solver.gridCellNodes[c].mass = 1;
+            solver.gridCellNodes[c].specificHeat = 1;
+        }
+        solver.gridCellNodes[0].temperature = temperature0;
+        solver.gridCellNodes[1].temperature = temperature1;
+        solver.gridFaceXNodes.thermalConductivity[solver.getGridFaceXNodeIndex(1, 0, 0)] = 1;
+    }
+
+    static std::vector<double> implicitHeatStep(LavaSolver &solver) {
+        std::vector<double> x = {solver.gridCellNodes[0].temperature, solver.gridCellNodes[1].temperature};
+        auto next_x = x;
+        conjugateResidualSolver(&solver, &LavaSolver::implicitHeatIntegrationMatrix, next_x, x, 50);
+        return next_x;
+    }
+
+    static std::vector<double> integrateHeat(LavaSolver &solver, LavaSolver::HeatIntegration heatIntegration) {
+        solver.heatIntegration = heatIntegration;
+
+        std::vector<double> x, next_x;
+        for (auto const &cellNode : solver.gridCellNodes) {
+            x.push_back(cellNode.temperature);
+        }
+        next_x = x;
+        solver.integrateHeat(next_x, x);
+        return next_x;
+    }
+
+    /**
+     * Checks the incrementally maintained cell types and lists against a classification from scratch
+     */
+    static void checkGridCellNodeTypes(LavaSolver &solver) {
+        std::vector<unsigned int> colliding, interior;
+        for (auto c = 0u; c < solver.gridCellNodes.size(); c++) {
+            auto type = solver.classifyGridCellNode(solver.gridCellNodes[c]);
+            BOOST_TEST(solver.gridCellNodes[c].type == type);
+
+            if (type == COLLIDING) colliding.push_back(c);
+            else if (type == INTERIOR) interior.push_back(c);
+        }
+
+        auto sorted = [](std::vector<unsigned int> cells) {
+            std::sort(cells.begin(), cells.end());
+            return cells;
+        };
+        BOOST_TEST(sorted(solver.collidingGridCellNodes) == colliding);
+        BOOST_TEST(sorted(solver.interiorGridCellNodes) == interior);
+    }
+
+    static glm::dvec3 tightNablaN(LavaSolver &solver, glm::dvec3 const &gridPosition,
+                                  glm::dvec3 const &particlePosition) {
+        return solver.tight_nabla_n(gridPosition, particlePosition);
+    }
+
+    static std::vector<glm::dvec3> tightNablaNStencil(LavaSolver &solver, glm::dvec3 const &stencilPosition,
+                                                      glm::dvec3 const &particlePosition) {
+        std::vector<glm::dvec3> nabla(64);
+        solver.tight_nabla_n(stencilPosition, particlePosition, nabla.data());
+        return nabla;
+    }
+
+    static size_t numInteriorGridCellNodes(LavaSolver const &solver) {
+        return solver.interiorGridCellNodes.size();
+    }
+
+};
+
+
 BOOST_AUTO_TEST_SUITE(test_conjugate_gradient_method)
 
     BOOST_AUTO_TEST_CASE(test1) {
@@ -184,10 +270,72 @@ BOOST_AUTO_TEST_SUITE(test_n)
 
     }
 
+    BOOST_AUTO_TEST_CASE(tight_nabla_n_stencil) {
+
+        // The stencil overload must match the per-node gradients on the face stencils step 9 gathers from
+        LavaSolver solver(0.1, glm::uvec3(8, 8, 8));
+        solver.propagateSimulationParametersUpdate();
+
+        CounterRandom random(1);
+        for (auto p = 0; p < 20; p++) {
+            glm::dvec3 particlePosition(random.uniform(0.2, 0.6), random.uniform(0.2, 0.6), random.uniform(0.2, 0.6));
+
+            for (auto const &offset : {glm::dvec3(0.5, 1, 1), glm::dvec3(1, 0.5, 1), glm::dvec3(1, 1, 0.5)}) {
+                auto stencilPosition = glm::dvec3(glm::ivec3(particlePosition / 0.1 - offset)) * 0.1 -
+                                       (glm::dvec3(1) - offset) * 0.1;
+                auto nabla = SolverTests::tightNablaNStencil(solver, stencilPosition, particlePosition);
+
+                for (unsigned int i = 0; i < 64; i++) {
+                    auto gridPosition = stencilPosition + 0.1 * glm::dvec3(i / 16, (i / 4) % 4, i % 4);
+                    auto expected = SolverTests::tightNablaN(solver, gridPosition, particlePosition);
+                    for (auto d = 0; d < 3; d++) {
+                        BOOST_TEST(std::abs(nabla[i][d] - expected[d]) < 1e-9);
+                    }
+                }
+            }
+        }
+
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_AUTO_TEST_SUITE(test_temperature)
 
+    BOOST_AUTO_TEST_CASE(test_implicit_heat_step) {
+
+        // Backward Euler keeps the mean and divides the difference by 1 + 2 delta_t
+        LavaSolver solver(1, glm::uvec3(2, 1, 1));
+        solver.delta_t = 0.1;
+        SolverTests::makeHeatCells(solver, 100, 0);
+
+        auto temperatures = SolverTests::implicitHeatStep(solver);
+        BOOST_TEST(temperatures[0] < 100);
+        BOOST_TEST(temperatures[1] > 0);
+        BOOST_TEST(temperatures[0] == 50 + 50 / 1.2, tt::tolerance(1e-4));
+        BOOST_TEST(temperatures[1] == 50 - 50 / 1.2, tt::tolerance(1e-4));
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_heat_integrations_agree) {
+
+        // A step well below the explicit stability limit of 0.5, where both integrations are first order accurate
+        LavaSolver solver(1, glm::uvec3(2, 1, 1));
+        solver.delta_t = 1e-3;
+        SolverTests::makeHeatCells(solver, 100, 0);
+
+        auto explicitTemperatures = SolverTests::integrateHeat(solver, LavaSolver::EXPLICIT_HEAT_INTEGRATION);
+        auto implicitTemperatures = SolverTests::integrateHeat(solver, LavaSolver::IMPLICIT_HEAT_INTEGRATION);
+        auto autoTemperatures = SolverTests::integrateHeat(solver, LavaSolver::AUTO_HEAT_INTEGRATION);
+
+        // Within a thousandth of a degree over a hundred degree difference
+        for (auto c = 0; c < 2; c++) {
+            BOOST_TEST(std::abs(explicitTemperatures[c] - implicitTemperatures[c]) < 1e-3);
+            BOOST_TEST(std::abs(autoTemperatures[c] - implicitTemperatures[c]) < 1e-3);
+        }
+        BOOST_TEST(explicitTemperatures[0] == 99.9, tt::tolerance(1e-6));
+
+    }
+
     BOOST_AUTO_TEST_CASE(test_small_increments) {
 
         LavaParticleNode node({}, 1);
@@ -236,4 +384,675 @@ BOOST_AUTO_TEST_SUITE(test_temperature)
 
     }
 
+    BOOST_AUTO_TEST_CASE(test_batch) {
+
+        double startTemperatures[] = {20, 20, 50, 50, 0, -30, -30};
+        double temperatureDifferences[] = {1, 50, -1, -50, 0.5, 1, 50};
+
+        std::vector<LavaParticleNode> nodes;
+        for (auto temperature : startTemperatures) {
+            nodes.emplace_back(glm::dvec3(), 1);
+            nodes.back().temperature = temperature;
+        }
+
+        LavaSolver::TemperatureBatch batch;
+        batch.resize(nodes.size());
+        for (auto p = 0; p < nodes.size(); p++) {
+            batch.temperature[p] = nodes[p].temperature;
+            batch.latentHeat[p] = nodes[p].latentHeat;
+            batch.temperatureDifference[p] = temperatureDifferences[p];
+            batch.mass[p] = nodes[p].mass;
+            batch.specificHeat[p] = nodes[p].specificHeat;
+            batch.fusionTemperature[p] = nodes[p].fusionTemperature;
+            batch.latentHeatOfFusion[p] = nodes[p].latentHeatOfFusion;
+        }
+
+        // Walk every node through its phase regimes and compare against the scalar version
+        for (auto step = 0; step < 200; step++) {
+            LavaSolver::applyTemperatureDifferences(batch);
+
+            for (auto p = 0; p < nodes.size(); p++) {
+                LavaSolver::applyTemperatureDifference(nodes[p], temperatureDifferences[p]);
+
+                BOOST_TEST(batch.temperature[p] == nodes[p].temperature, tt::tolerance(1e-9));
+                BOOST_TEST(batch.latentHeat[p] == nodes[p].latentHeat, tt::tolerance(1e-9));
+            }
+        }
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(test_cell_classification)
+
+    BOOST_AUTO_TEST_CASE(test_moving_particles) {
+
+        // A block of particles thrown sideways over a colliding floor, crossing faces every tick
+        LavaSolver solver(0.1, glm::uvec3(10, 10, 10));
+        solver.delta_t = 0.02;
+        solver.isNodeColliding = [](Node &node) { return node.position.z < 0.15; };
+        solver.handleNodeCollisionVelocityUpdate = [](Node &node) {};
+
+        for (auto x = 0; x < 6; x++) {
+            for (auto y = 0; y < 6; y++) {
+                for (auto z = 0; z < 6; z++) {
+                    solver.particleNodes.emplace_back(glm::dvec3(0.3 + 0.05 * x, 0.3 + 0.05 * y, 0.3 + 0.05 * z),
+                                                      0.125);
+                    solver.particleNodes.back().velocity = glm::dvec3(1.5, 0.5, 0);
+                }
+            }
+        }
+
+        std::vector<size_t> numInterior;
+        for (auto tick = 0; tick < 10; tick++) {
+            solver.update();
+            SolverTests::checkGridCellNodeTypes(solver);
+            numInterior.push_back(SolverTests::numInteriorGridCellNodes(solver));
+        }
+
+        // Cells were reclassified along the way
+        BOOST_TEST(numInterior.front() > 0);
+        BOOST_TEST(*std::min_element(numInterior.begin(), numInterior.end()) !=
+                   *std::max_element(numInterior.begin(), numInterior.end()));
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(test_state)
+
+    BOOST_AUTO_TEST_CASE(test_snow_round_trip) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        snowSolver.tick = 12;
+        for (auto p = 0; p < 10; p++) {
+            snowSolver.particleNodes.emplace_back(glm::dvec3(p, 2 * p, 3 * p), 0.5 + p);
+            snowSolver.particleNodes.back().velocity = glm::dvec3(-p, 1, p);
+        }
+
+        snowSolver.saveState("test_snow_round_trip.snowstate");
+
+        StateFileView state("test_snow_round_trip.snowstate");
+        BOOST_TEST(state.isOpen());
+        BOOST_TEST(state.header().version == STATE_FILE_VERSION);
+        BOOST_TEST(state.header().solver == STATE_FILE_SOLVER_SNOW);
+        BOOST_TEST(state.numParticles() == 10);
+        BOOST_TEST(state.parameter("tick") == 12);
+        BOOST_TEST(state.columnValues<double>("position", 3)[3 * 3 + 1] == 6);
+        BOOST_TEST(state.column("deformElastic")->bytes == 10 * 9 * sizeof(double));
+        BOOST_TEST(!state.column("temperature"));
+
+        SnowSolver loadedSnowSolver("test_snow_round_trip.snowstate");
+        BOOST_TEST(loadedSnowSolver.size.z == 6);
+        BOOST_TEST(loadedSnowSolver.particleNodes.size() == 10);
+        for (auto p = 0; p < 10; p++) {
+            BOOST_TEST(loadedSnowSolver.particleNodes[p].position.z == 3 * p);
+            BOOST_TEST(loadedSnowSolver.particleNodes[p].velocity.x == -p);
+            BOOST_TEST(loadedSnowSolver.particleNodes[p].mass == 0.5 + p);
+        }
+
+        std::remove("test_snow_round_trip.snowstate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_lava_round_trip) {
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 10; p++) {
+            lavaSolver.particleNodes.emplace_back(glm::dvec3(p, 2 * p, 3 * p), 0.5 + p);
+            lavaSolver.particleNodes.back().temperature = 10 * p;
+        }
+
+        lavaSolver.saveState("test_lava_round_trip.lavastate");
+
+        LavaSolver loadedLavaSolver("test_lava_round_trip.lavastate");
+        BOOST_TEST(loadedLavaSolver.particleNodes.size() == 10);
+        for (auto p = 0; p < 10; p++) {
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].position.y == 2 * p);
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].temperature == 10 * p);
+        }
+
+        std::remove("test_lava_round_trip.lavastate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_field_selection) {
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 10; p++) {
+            lavaSolver.particleNodes.emplace_back(glm::dvec3(p, 2 * p, 3 * p), 0.5 + p);
+            lavaSolver.particleNodes.back().velocity = glm::dvec3(1, 1, 1);
+            lavaSolver.particleNodes.back().temperature = 10 * p;
+        }
+
+        lavaSolver.saveState("test_field_selection.lavastate");
+
+        LavaSolver loadedLavaSolver(0.1, glm::uvec3(4, 5, 6));
+        loadedLavaSolver.loadState("test_field_selection.lavastate", {"position", "temperature"});
+        BOOST_TEST(loadedLavaSolver.particleNodes.size() == 10);
+        for (auto p = 0; p < 10; p++) {
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].position.x == p);
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].temperature == 10 * p);
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].velocity.x == 0);
+        }
+
+        std::remove("test_field_selection.lavastate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_viz_fields) {
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 10; p++) {
+            lavaSolver.particleNodes.emplace_back(glm::dvec3(p, 2 * p, 3 * p), 0.5 + p);
+        }
+
+        std::vector<char> buffer;
+        auto bytes = lavaSolver.packState(buffer, STATE_FILE_UNCOMPRESSED, nullptr, LavaSolver::vizFields);
+        BOOST_TEST(bytes < lavaSolver.packState(buffer));
+
+        bytes = lavaSolver.packState(buffer, STATE_FILE_UNCOMPRESSED, nullptr, LavaSolver::vizFields);
+        std::ofstream file("test_viz_fields.lavastate", std::ofstream::binary);
+        file.write(buffer.data(), bytes);
+        file.close();
+
+        StateFileView state("test_viz_fields.lavastate");
+        BOOST_TEST(state.header().numColumns == LavaSolver::vizFields.size());
+        BOOST_TEST(state.column("temperature") != nullptr);
+        BOOST_TEST(state.column("mass") == nullptr);
+
+        std::remove("test_viz_fields.lavastate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_legacy_file) {
+
+        SnowSolver::SNOW_SOLVER_STATE_HEADER header{};
+        header.h = 0.1;
+        header.size = glm::uvec3(4, 5, 6);
+        header.tick = 3;
+        header.numParticles = 2;
+
+        SnowSolver::SNOW_SOLVER_STATE_PARTICLE particles[2]{};
+        particles[1].position = glm::dvec3(1, 2, 3);
+        particles[1].deformElastic = glm::dmat3(2);
+
+        std::ofstream file("test_legacy_file.snowstate", std::ofstream::binary);
+        file.write(reinterpret_cast<char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<char *>(particles), sizeof(particles));
+        file.close();
+
+        SnowSolver snowSolver("test_legacy_file.snowstate");
+        BOOST_TEST(snowSolver.tick == 3);
+        BOOST_TEST(snowSolver.particleNodes.size() == 2);
+        BOOST_TEST(snowSolver.particleNodes[1].position.z == 3);
+        BOOST_TEST(snowSolver.particleNodes[1].deformElastic[1][1] == 2);
+
+        std::remove("test_legacy_file.snowstate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_codec_round_trip) {
+
+        // Spans several blocks, the last one partial
+        std::vector<double> values(300000);
+        for (auto i = 0; i < values.size(); i++) values[i] = i % 1000 * 0.25;
+
+        std::vector<uint8_t> encoded;
+        auto bytes = encodeColumn(reinterpret_cast<uint8_t const *>(values.data()), values.size(), sizeof(double),
+                                  encoded);
+        BOOST_TEST(bytes < values.size() * sizeof(double));
+
+        std::vector<double> decoded(values.size());
+        BOOST_TEST(decodeColumn(encoded.data(), bytes, values.size(), sizeof(double),
+                                reinterpret_cast<uint8_t *>(decoded.data())));
+        BOOST_TEST((decoded == values));
+
+        BOOST_TEST(!decodeColumn(encoded.data(), bytes / 2, values.size(), sizeof(double),
+                                 reinterpret_cast<uint8_t *>(decoded.data())));
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_lossless_round_trip) {
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 1000; p++) {
+            lavaSolver.particleNodes.emplace_back(glm::dvec3(p % 4, p % 5, p % 6) * 0.1, 0.5);
+            lavaSolver.particleNodes.back().temperature = p % 10;
+        }
+
+        lavaSolver.saveState("test_lossless_round_trip.lavastate", STATE_FILE_LOSSLESS);
+
+        StateFileView state("test_lossless_round_trip.lavastate");
+        BOOST_TEST(state.isOpen());
+        BOOST_TEST(state.column("mass")->codec == STATE_FILE_CODEC_SHUFFLE_LZ4);
+        BOOST_TEST(state.columnValues<float>("mass", 1) == nullptr);
+
+        LavaSolver loadedLavaSolver("test_lossless_round_trip.lavastate");
+        BOOST_TEST(loadedLavaSolver.particleNodes.size() == 1000);
+        for (auto p = 0; p < 1000; p++) {
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].position == lavaSolver.particleNodes[p].position);
+            BOOST_TEST(loadedLavaSolver.particleNodes[p].temperature == p % 10);
+        }
+
+        std::remove("test_lossless_round_trip.lavastate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_lossy_round_trip) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 1000; p++) {
+            snowSolver.particleNodes.emplace_back(glm::dvec3(0.4, 0.5, 0.6) * (p / 1000.0), 1);
+            snowSolver.particleNodes.back().velocity = glm::dvec3(p, 0, 0);
+        }
+
+        snowSolver.saveState("test_lossy_round_trip.snowstate", STATE_FILE_LOSSY);
+
+        StateFileView state("test_lossy_round_trip.snowstate");
+        BOOST_TEST(state.column("position")->codec == STATE_FILE_CODEC_QUANTIZED16_SHUFFLE_LZ4);
+        auto quantization = state.column("position")->quantization;
+        BOOST_TEST(std::abs(quantization - 0.6 / 65535) < 1e-12);
+
+        SnowSolver loadedSnowSolver("test_lossy_round_trip.snowstate");
+        BOOST_TEST(loadedSnowSolver.particleNodes.size() == 1000);
+        for (auto p = 0; p < 1000; p++) {
+            auto error = loadedSnowSolver.particleNodes[p].position - snowSolver.particleNodes[p].position;
+            BOOST_TEST(std::abs(error.x) <= quantization / 2 + 1e-12);
+            BOOST_TEST(std::abs(error.z) <= quantization / 2 + 1e-12);
+            BOOST_TEST(loadedSnowSolver.particleNodes[p].velocity.x == p); // Not quantized
+        }
+
+        std::remove("test_lossy_round_trip.snowstate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_delta_frames) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 1000; p++) {
+            snowSolver.particleNodes.emplace_back(glm::dvec3(0.4, 0.5, 0.6) * (p / 1000.0), 1);
+        }
+
+        StateFileKeyframes keyframes(3);
+        std::vector<char> buffer;
+        std::vector<size_t> bytes;
+        std::vector<glm::dvec3> positions;
+        for (auto frame = 0; frame < 5; frame++) {
+            for (auto &particleNode : snowSolver.particleNodes) particleNode.position.y += 1e-4;
+
+            keyframes.frame = frame;
+            bytes.push_back(snowSolver.packState(buffer, STATE_FILE_LOSSLESS, &keyframes));
+
+            std::ofstream file("test_delta_frames-" + std::to_string(frame) + ".snowstate", std::ofstream::binary);
+            file.write(buffer.data(), bytes.back());
+
+            if (frame == 2) {
+                for (auto const &particleNode : snowSolver.particleNodes) positions.push_back(particleNode.position);
+            }
+        }
+
+        BOOST_TEST(bytes[1] < bytes[0]);
+
+        // The keyframe position and velocity copies at least
+        BOOST_TEST(keyframes.memoryUsage() >= 2 * snowSolver.particleNodes.size() * sizeof(glm::dvec3));
+
+        StateFileView state("test_delta_frames-4.snowstate");
+        BOOST_TEST(state.isOpen());
+        BOOST_TEST(state.parameter("keyframe", -1) == 3);
+        BOOST_TEST((state.column("position")->codec & STATE_FILE_CODEC_DELTA) != 0);
+
+        BOOST_TEST(state.open("test_delta_frames-3.snowstate"));
+        BOOST_TEST(state.parameter("keyframe", -1) == -1);
+
+        // Random access, decoded against frame 0
+        SnowSolver loadedSnowSolver("test_delta_frames-2.snowstate");
+        BOOST_TEST(loadedSnowSolver.particleNodes.size() == 1000);
+        for (auto p = 0; p < 1000; p++) {
+            BOOST_TEST(loadedSnowSolver.particleNodes[p].position == positions[p]);
+        }
+
+        for (auto frame = 0; frame < 5; frame++) {
+            std::remove(("test_delta_frames-" + std::to_string(frame) + ".snowstate").c_str());
+        }
+
+        BOOST_TEST(!state.open("test_delta_frames-4.snowstate"));
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_unreadable_columns) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        for (auto p = 0; p < 1000; p++) {
+            snowSolver.particleNodes.emplace_back(glm::dvec3(0.4, 0.5, 0.6) * (p / 1000.0), 1);
+            snowSolver.particleNodes.back().velocity = glm::dvec3(p, 0, 0);
+        }
+
+        auto writeFile = [](std::string const &filename, std::vector<char> const &buffer, size_t bytes) {
+            std::ofstream file(filename, std::ofstream::binary | std::ofstream::trunc);
+            file.write(buffer.data(), bytes);
+        };
+
+        // A compressed column that cannot be decoded
+        std::vector<char> buffer;
+        auto bytes = snowSolver.packState(buffer, STATE_FILE_LOSSLESS);
+        writeFile("test_unreadable_columns.snowstate", buffer, bytes);
+
+        STATE_FILE_COLUMN velocity;
+        {
+            StateFileView state("test_unreadable_columns.snowstate");
+            BOOST_TEST(state.column("velocity")->codec == STATE_FILE_CODEC_SHUFFLE_LZ4);
+            velocity = *state.column("velocity");
+        }
+        std::fill_n(buffer.begin() + velocity.offset, velocity.bytes, static_cast<char>(0xff));
+        writeFile("test_unreadable_columns.snowstate", buffer, bytes);
+
+        SnowSolver loadedSnowSolver(0.1, glm::uvec3(4, 5, 6));
+        BOOST_TEST(!loadedSnowSolver.loadState("test_unreadable_columns.snowstate"));
+        BOOST_TEST(loadedSnowSolver.loadState("test_unreadable_columns.snowstate", {"position", "mass"}));
+
+        // Absent columns are only an error if they are asked for
+        bytes = snowSolver.packState(buffer, STATE_FILE_UNCOMPRESSED, nullptr, SnowSolver::vizFields);
+        writeFile("test_unreadable_columns.snowstate", buffer, bytes);
+        BOOST_TEST(loadedSnowSolver.loadState("test_unreadable_columns.snowstate"));
+        BOOST_TEST(!loadedSnowSolver.loadState("test_unreadable_columns.snowstate", {"position", "mass"}));
+
+        // A delta column whose keyframe column is gone
+        StateFileKeyframes keyframes(3);
+        for (auto frame = 0; frame < 2; frame++) {
+            keyframes.frame = frame;
+            bytes = snowSolver.packState(buffer, STATE_FILE_LOSSLESS, &keyframes);
+            writeFile("test_unreadable_columns-" + std::to_string(frame) + ".snowstate", buffer, bytes);
+        }
+        BOOST_TEST(loadedSnowSolver.loadState("test_unreadable_columns-1.snowstate"));
+
+        bytes = snowSolver.packState(buffer, STATE_FILE_LOSSLESS, nullptr,
+                                     {"velocity", "mass", "volume0", "deformElastic", "deformPlastic"});
+        writeFile("test_unreadable_columns-0.snowstate", buffer, bytes);
+        BOOST_TEST(!loadedSnowSolver.loadState("test_unreadable_columns-1.snowstate"));
+
+        std::remove("test_unreadable_columns.snowstate");
+        std::remove("test_unreadable_columns-0.snowstate");
+        std::remove("test_unreadable_columns-1.snowstate");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_frame_index) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        snowSolver.particleNodes.emplace_back(glm::dvec3(0.1, 0.2, 0.3), 2);
+        snowSolver.particleNodes.emplace_back(glm::dvec3(0.3, 0.1, 0.2), 1);
+        snowSolver.particleNodes.back().velocity = glm::dvec3(0, 2, 0);
+
+        std::remove("test_frame_index.index");
+        {
+            FrameIndexWriter writer;
+            BOOST_TEST(writer.open("test_frame_index.index", STATE_FILE_SOLVER_SNOW));
+            for (auto frame = 1; frame <= 3; frame++) {
+                FRAME_INDEX_RECORD record{};
+                record.frame = frame;
+                record.tick = 10 * frame;
+                computeFrameIndexStats(record, snowSolver.particleNodes);
+                BOOST_TEST(writer.append(record));
+            }
+        }
+        {
+            // Resumed from frame 2
+            FrameIndexWriter writer;
+            BOOST_TEST(!writer.open("test_frame_index.index", STATE_FILE_SOLVER_LAVA));
+            BOOST_TEST(writer.open("test_frame_index.index", STATE_FILE_SOLVER_SNOW));
+            FRAME_INDEX_RECORD record{};
+            record.frame = 3;
+            record.tick = 31;
+            BOOST_TEST(writer.append(record));
+        }
+
+        FrameIndexView index("test_frame_index.index");
+        BOOST_TEST(index.isOpen());
+        BOOST_TEST(index.numRecords() == 4);
+        BOOST_TEST(index.records()[0].numParticles == 2);
+        BOOST_TEST(index.records()[0].boundsMin[1] == 0.1);
+        BOOST_TEST(index.records()[0].boundsMax[0] == 0.3);
+        BOOST_TEST(index.records()[0].kineticEnergy == 2);
+        BOOST_TEST(index.find(2)->tick == 20);
+        BOOST_TEST(index.find(3)->tick == 31);
+        BOOST_TEST(index.find(4) == nullptr);
+
+        std::remove("test_frame_index.index");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_missing_file) {
+
+        StateFileView state("test_missing_file.snowstate");
+        BOOST_TEST(!state.isOpen());
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(test_time_step)
+
+    BOOST_AUTO_TEST_CASE(test_cfl_time_step) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 4, 4));
+        snowSolver.cfl = 0.5;
+        snowSolver.particleNodes.emplace_back(glm::dvec3(0.2), 1);
+        snowSolver.particleNodes.back().velocity = glm::dvec3(0, 0, -2);
+
+        // Undeformed particles only move by their velocity
+        BOOST_TEST(snowSolver.cflTimeStep() == 0.5 * 0.1 / 2, boost::test_tools::tolerance(1e-12));
+
+        // Elastic waves are faster, and faster in compressed snow
+        snowSolver.particleNodes.back().volume0 = 1e-3;
+        auto restTimeStep = snowSolver.cflTimeStep();
+        BOOST_TEST(restTimeStep < 0.5 * 0.1 / 2);
+
+        snowSolver.particleNodes.back().deformPlastic = glm::dmat3(0.9);
+        BOOST_TEST(snowSolver.cflTimeStep() < restTimeStep);
+
+        // The grid is still built by the first update
+        BOOST_TEST(snowSolver.simulationParametersDidUpdate);
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 4, 4));
+        lavaSolver.cfl = 0.5;
+        lavaSolver.particleNodes.emplace_back(glm::dvec3(0.2), 1);
+        lavaSolver.particleNodes.back().velocity = glm::dvec3(0, 0, -2);
+        BOOST_TEST(lavaSolver.cflTimeStep() == 0.5 * 0.1 / 2, boost::test_tools::tolerance(1e-12));
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_frame_boundary) {
+
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 4, 4));
+        snowSolver.particleNodes.emplace_back(glm::dvec3(0.2), 1);
+        snowSolver.particleNodes.back().velocity = glm::dvec3(0, 0, -2);
+
+        // Fixed time steps only shorten the last tick of a frame
+        std::vector<double> steps;
+        while (snowSolver.time < 1.0 / 60 - 1e-12) {
+            snowSolver.chooseTimeStep(1.0 / 60);
+            steps.push_back(snowSolver.delta_t);
+            snowSolver.time += snowSolver.delta_t;
+        }
+        BOOST_TEST(steps.size() == 4);
+        BOOST_TEST(steps[2] == 5e-3);
+        BOOST_TEST(steps[3] == 1.0 / 60 - 3 * 5e-3, boost::test_tools::tolerance(1e-12));
+        BOOST_TEST(snowSolver.time == 1.0 / 60, boost::test_tools::tolerance(1e-12));
+
+        snowSolver.chooseTimeStep(2.0 / 60);
+        BOOST_TEST(snowSolver.delta_t == 5e-3);
+
+        // Exact multiples of the time step do not end on a sliver of a tick
+        snowSolver.time = 1.0 / 60 + 3 * 5e-3 - 1e-15;
+        snowSolver.chooseTimeStep(1.0 / 60 + 4 * 5e-3);
+        BOOST_TEST(snowSolver.delta_t == 5e-3 + 1e-15, boost::test_tools::tolerance(1e-9));
+
+        snowSolver.time = 0;
+        snowSolver.maxDelta_t = 0;
+
+        // The upper bound is the initial time step, the ticks of a frame end on it without a sliver of a tick
+        snowSolver.cfl = 0.5;
+        snowSolver.delta_t = 1e-2;
+        auto ticks = 0;
+        while (snowSolver.time < 1.0 / 60 - 1e-12) {
+            snowSolver.chooseTimeStep(1.0 / 60);
+            BOOST_TEST(snowSolver.delta_t <= 1e-2);
+            BOOST_TEST(snowSolver.delta_t >= 1e-2 / 2);
+            snowSolver.time += snowSolver.delta_t;
+            ticks++;
+        }
+        BOOST_TEST(snowSolver.maxDelta_t == 1e-2);
+        BOOST_TEST(snowSolver.time == 1.0 / 60, boost::test_tools::tolerance(1e-12));
+        BOOST_TEST(ticks == 2);
+
+        snowSolver.chooseTimeStep(1);
+        BOOST_TEST(snowSolver.delta_t == 1e-2);
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(test_profiler)
+
+    BOOST_AUTO_TEST_CASE(test_phases) {
+
+        Profiler profiler;
+        for (auto i = 0; i < 3; i++) {
+            ProfilerScope phase(&profiler, "first");
+            phase.next("second");
+            if (i == 0) phase.next("third");
+        }
+
+        auto const &phases = profiler.getPhases();
+        BOOST_TEST(phases.size() == 3);
+        BOOST_TEST(std::string(phases[1].name) == "second");
+        BOOST_TEST(phases[0].calls == 3);
+        BOOST_TEST(phases[1].calls == 3);
+        BOOST_TEST(phases[2].calls == 1);
+        BOOST_TEST(phases[0].seconds >= 0);
+
+        profiler.reset();
+        BOOST_TEST(profiler.getPhases().size() == 3);
+        BOOST_TEST(profiler.getPhases()[0].calls == 0);
+        BOOST_TEST(profiler.phase("third") == 2);
+
+        // Solvers without profiler are not timed
+        ProfilerScope phase(nullptr, "first");
+        phase.next("second");
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_perf_counters) {
+
+        // Counters depend on the machine, only check they are consistent when they are there
+        PerfCounters counters;
+        if (!counters.open()) {
+            BOOST_TEST(!counters.isOpen());
+            return;
+        }
+
+        Profiler profiler;
+        profiler.counters = &counters;
+        {
+            ProfilerScope phase(&profiler, "sum");
+            volatile double sum = 0;
+            for (auto i = 0; i < 1000000; i++) sum = sum + i;
+        }
+
+        auto const &phase = profiler.getPhases()[0];
+        if (counters.isAvailable(PERF_INSTRUCTIONS)) BOOST_TEST(phase.counters[PERF_INSTRUCTIONS] > 1000000);
+        if (counters.isAvailable(PERF_CYCLES)) BOOST_TEST(phase.counters[PERF_CYCLES] > 0);
+
+    }
+
+    BOOST_AUTO_TEST_CASE(test_trace) {
+
+        TraceSink trace;
+        BOOST_TEST(trace.open("test_trace.json"));
+
+        Profiler profiler;
+        profiler.trace = &trace;
+        {
+            ProfilerScope phase(&profiler, "first");
+            phase.setArgument("iterations", 12);
+            phase.next("second");
+        }
+        trace.close();
+
+        std::ifstream file("test_trace.json");
+        std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        BOOST_TEST(json.find("\"traceEvents\"") != std::string::npos);
+        BOOST_TEST(json.find("\"name\": \"first\"") < json.find("\"name\": \"second\""));
+        BOOST_TEST(json.find("\"args\": {\"iterations\": 12") != std::string::npos);
+        BOOST_TEST(json.find("]}") != std::string::npos);
+
+        std::remove("test_trace.json");
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(test_memory_usage)
+
+    BOOST_AUTO_TEST_CASE(test_before_update) {
+
+        auto bytes = [](std::vector<SolverMemoryUsage> const &usages, std::string const &name) -> size_t {
+            for (auto const &usage : usages) {
+                if (name == usage.name) return usage.bytes;
+            }
+            return 0;
+        };
+
+        // Grids are accounted for before the first update allocates them
+        SnowSolver snowSolver(0.1, glm::uvec3(4, 5, 6));
+        snowSolver.particleNodes.emplace_back(glm::dvec3(0.2), 1);
+        auto snowUsage = snowSolver.memoryUsage();
+        BOOST_TEST(bytes(snowUsage, "grid") == 4 * 5 * 6 * sizeof(SnowGridNode));
+        BOOST_TEST(bytes(snowUsage, "particles") >= sizeof(SnowParticleNode));
+        BOOST_TEST(bytes(snowUsage, "velocity_solve") == 0);
+
+        snowSolver.beta = 1;
+        BOOST_TEST(bytes(snowSolver.memoryUsage(), "velocity_solve") > 0);
+
+        LavaSolver lavaSolver(0.1, glm::uvec3(4, 5, 6));
+        auto lavaUsage = lavaSolver.memoryUsage();
+        BOOST_TEST(bytes(lavaUsage, "grid_cells") == 4 * 5 * 6 * sizeof(LavaGridCellNode));
+        BOOST_TEST(bytes(lavaUsage, "grid_faces_x") == 5 * 5 * 6 * (6 * sizeof(double) + 2));
+        BOOST_TEST(bytes(lavaUsage, "grid_faces_z") == 4 * 5 * 7 * (6 * sizeof(double) + 2));
+        BOOST_TEST(bytes(lavaUsage, "particles") == 0);
+
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(test_counter_random)
+
+    BOOST_AUTO_TEST_CASE(test_streams) {
+
+        CounterRandom a(42), b(42), c(43);
+        std::vector<uint64_t> numbers;
+        for (auto i = 0; i < 100; i++) {
+            numbers.push_back(a.next());
+            BOOST_TEST(numbers.back() == b.next());
+        }
+        BOOST_TEST(a.getCounter() == 100);
+        BOOST_TEST(numbers[0] != c.next());
+
+        // Any part of a stream can be drawn on its own, e.g. by another thread
+        CounterRandom d(42, 50);
+        BOOST_TEST(d.next() == numbers[50]);
+        BOOST_TEST(a.at(99) == numbers[99]);
+
+        for (auto i = 0; i < 1000; i++) {
+            auto x = c.uniform(-2, 3);
+            BOOST_TEST((x >= -2 && x < 3));
+        }
+
+    }
+
 BOOST_AUTO_TEST_SUITE_END()